@@ -41,6 +41,21 @@ extern "C" {
  * and read() functions to transmit or receive the data). Conversely, functions/data
  * structures that refer to the virtual communication channels use the keywords "send"
  * and "recv" to avoid confusion.
+ *
+ * Threads: the library has no global state, and the sender and the receiver of a
+ * connection share nothing, so one thread may send and write while another one reads and
+ * receives, without locking. Each half owns its configuration struct, including the
+ * buffers and the functions referenced by it:
+ * - smux_config_send (sender): write_buf, write_fn/write_fd, the elastic segments and
+ *   alloc_fn/release_fn/alloc_fd, and the write buffer, segment, reservation and lazy
+ *   encoding state in _internal. Used by smux_send*(), smux_write*() and
+ *   smux_free(cs, NULL).
+ * - smux_config_recv (receiver): read_buf, read_fn/read_fd, subscribed and the read buffer
+ *   and decoding state in _internal. Used by smux_recv(), smux_subscribe(), smux_read*()
+ *   and smux_free(NULL, cr).
+ *
+ * Calls on the same half must not overlap. smux_init() and proto.esc of both halves must
+ * be set up before the threads start.
  */
 
 /// identifiers of virtual channels
@@ -74,6 +89,22 @@ typedef ssize_t (*smux_write_fn)(void *fd, const void *buf, size_t count);
  */
 typedef ssize_t (*smux_read_fn)(void *fd, void *buf, size_t count);
 
+/**
+ * \brief                   function for allocating send buffer segments
+ * \param fd                pointer to user data (e.g., a memory pool)
+ * \param size              number of bytes to allocate
+ * \retval !NULL            pointer to the allocated memory
+ * \retval NULL             allocation failed
+ */
+typedef void *(*smux_alloc_fn)(void *fd, size_t size);
+
+/**
+ * \brief                   function for releasing memory obtained from a smux_alloc_fn
+ * \param fd                pointer to user data (e.g., a memory pool)
+ * \param ptr               memory to release
+ */
+typedef void (*smux_release_fn)(void *fd, void *ptr);
+
 /**
  * \brief                   configuration struct for sender
  *
@@ -113,13 +144,59 @@ struct smux_config_send
         smux_write_fn write_fn;
         /// data (file descriptor) to pass to write_fn
         void *write_fd;
+
+        /**
+         * \brief                   lazy encoding (default: 0)
+         *
+         * If non-zero, the write buffer stores raw payload together with small frame
+         * descriptors and the SMUX protocol is applied while writing out. Must not be
+         * changed while data is buffered.
+         */
+        int lazy;
     } buffer;
 
+    /**
+     * \brief                   elastic buffer settings
+     *
+     * Optional. If alloc_fn is set, data that does not fit into write_buf anymore is stored
+     * in a chain of additional segments, which are requested from alloc_fn on demand and
+     * handed back to release_fn as soon as they have been written out.
+     */
+    struct
+    {
+        /// function to allocate segments (NULL disables elastic mode)
+        smux_alloc_fn alloc_fn;
+        /// function to release segments
+        smux_release_fn release_fn;
+        /// data pointer to pass to alloc_fn and release_fn
+        void *alloc_fd;
+
+        size_t segment_size; ///< size of a single segment in bytes (default: 256)
+        size_t max_size; ///< maximum size of all segments in bytes (0 = unlimited)
+    } elastic;
+
     // internal state
     struct
     {
         unsigned wb_head; // next character to write
         unsigned wb_tail; // next character to read
+
+        void *seg_first; // oldest segment (next to write)
+        void *seg_last; // newest segment (next to fill)
+        size_t seg_size; // allocated size of all segments
+        size_t seg_used; // characters waiting in segments
+
+        unsigned rsv_start; // start of the reserved payload area
+        unsigned rsv_end; // end of contiguous free space after rsv_start
+        size_t rsv_len; // size of the reserved payload area (0 = no reservation)
+        smux_channel rsv_ch; // channel of the reservation
+
+        char lz_desc[3]; // partially read frame descriptor
+        unsigned lz_desc_len; // valid bytes in lz_desc
+        size_t lz_remain; // payload bytes left in the current frame
+        char lz_out[4]; // generated header or escape sequence
+        unsigned lz_out_pos; // next byte of lz_out to write
+        unsigned lz_out_len; // valid bytes in lz_out
     } _internal;
 };
 
@@ -164,6 +241,15 @@ struct smux_config_recv
         void *read_fd;
     } buffer;
 
+    /**
+     * \brief                   channel subscriptions
+     *
+     * Bitmap of the channels to receive (bit ch % 8 of byte ch / 8), \see{smux_subscribe}.
+     * Data of other channels is skipped without being copied. By default, all channels are
+     * subscribed.
+     */
+    unsigned char subscribed[(smux_channel_max + 1) / 8];
+
     // internal state
     struct
     {
@@ -208,9 +294,62 @@ void smux_free(struct smux_config_send *cs, struct smux_config_recv *cr);
  *
  * This functions only copies the data into the internal write buffer (using the
  * SMUX protocol). To actually write data out, \see{smux_write} and \see{smux_write_buf}.
+ *
+ * In elastic mode (config->elastic.alloc_fn set), everything that does not fit into the
+ * write buffer is stored in additional segments, so 0 is only returned if the maximum
+ * segment size has been reached or an allocation failed.
  */
 size_t smux_send(struct smux_config_send *config, smux_channel ch, const void *buf, size_t count);
 
+/**
+ * \brief                   send a complete frame or nothing
+ * \param[in,out] config    initialized smux_config_send
+ * \param ch                virtual channel
+ * \param buf               data
+ * \param count             number of bytes (at most 65535)
+ * \retval >0               count, the frame has been copied to the write buffer
+ * \retval  0               not enough space, the write buffer is untouched
+ *
+ * Unlike \see{smux_send}, the data is never split. The exact size of the encoded frame is
+ * determined first and the data is only copied if the free space in the write buffer (or
+ * in the elastic buffer) suffices.
+ */
+size_t smux_send_atomic(struct smux_config_send *config, smux_channel ch, const void *buf, size_t count);
+
+/**
+ * \brief                   reserve space for a payload directly in the write buffer
+ * \param[in,out] config    initialized smux_config_send
+ * \param ch                virtual channel
+ * \param max_len           maximum number of payload bytes to write
+ * \retval !NULL            pointer to max_len writable bytes inside the write buffer
+ * \retval NULL             not enough contiguous space in the write buffer
+ *
+ * Allows to produce data in place instead of copying it with \see{smux_send}. The
+ * payload is written to the returned area and handed over with \see{smux_send_commit}.
+ * No other send function must be called on config in between (\see{smux_write} is fine).
+ *
+ * Reservations are only served from the write buffer, so NULL is returned while data is
+ * waiting in the elastic buffer. max_len must not exceed 65535.
+ *
+ * In lazy encoding mode, no escaping is necessary at all, so committing always succeeds.
+ */
+void *smux_send_reserve(struct smux_config_send *config, smux_channel ch, size_t max_len);
+
+/**
+ * \brief                   commit a payload written to a reserved area
+ * \param[in,out] config    initialized smux_config_send
+ * \param actual_len        number of bytes written (at most max_len of the reservation)
+ * \retval >0               number of committed bytes (always actual_len)
+ * \retval  0               nothing committed
+ *
+ * Escape characters in the payload are escaped in place (not in lazy encoding mode), so
+ * the free space right after the reserved area must be large enough to hold the additional
+ * bytes. If it is not, nothing is committed and the payload stays untouched in the reserved
+ * area. That area is part of the write buffer, so copy the payload out before sending it
+ * with another send function. In any case, the reservation is released.
+ */
+size_t smux_send_commit(struct smux_config_send *config, size_t actual_len);
+
 /**
  * \brief                   receive data from a virtual channel
  * \param[in,out] config    initialized smux_config_recv
@@ -231,6 +370,17 @@ size_t smux_recv(struct smux_config_recv *config, smux_channel *ch, void *buf, s
 
 
 
+/**
+ * \brief                   subscribe to or unsubscribe from a virtual channel
+ * \param[in,out] config    initialized smux_config_recv
+ * \param ch                virtual channel
+ * \param subscribe         non-zero to receive data of ch, 0 to skip it
+ *
+ * Changing the subscription of the channel currently being received takes effect
+ * immediately, i.e., the rest of the current frame is already skipped or received.
+ */
+void smux_subscribe(struct smux_config_recv *config, smux_channel ch, int subscribe);
+
 /**
  * \brief                   write multiplexed data using the configured write function
  * \param[in,out] config    initialized smux_config_send
@@ -244,6 +394,10 @@ size_t smux_recv(struct smux_config_recv *config, smux_channel *ch, void *buf, s
  * the write buffer is empty (return 0), the write function returned 0 (return >0) or
  * the write function has signalled an error (return <0).
  *
+ * Segments of the elastic buffer are written after the write buffer and released as soon
+ * as they are empty. The returned number of bytes includes the data waiting in segments.
+ * In lazy encoding mode, it refers to the stored (not yet encoded) data.
+ *
  * In case of an error, the buffer state is reverted, so the failing write is undone.
  */
 ssize_t smux_write(struct smux_config_send *config);
@@ -256,9 +410,19 @@ ssize_t smux_write(struct smux_config_send *config);
  * \retval >0               number of copied bytes
  * \retval  0               write buffer empty
  *
- * TODO: not yet implemented
+ * Alternative to \see{smux_write} if no write function is configured.
+ */
+size_t smux_write_buf(struct smux_config_send *config, void *buf, size_t count);
+
+/**
+ * \brief                   number of encoded bytes waiting to be written
+ * \param[in] config        initialized smux_config_send
+ * \return                  bytes in the write buffer and in the elastic buffer (plus the
+ *                          stored data of a partially encoded lazy frame)
+ *
+ * Counts the same bytes as the return value of \see{smux_write}, without writing anything.
  */
-//size_t smux_write_buf(struct smux_config_send *config, void *buf, size_t count);
+size_t smux_write_pending(struct smux_config_send const *config);
 
 
 
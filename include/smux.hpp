@@ -2,16 +2,28 @@
 #ifndef _SMUX_HPP_INCLUDED_
 #define _SMUX_HPP_INCLUDED_
 
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
 #include <istream>
 #include <ostream>
-#include <sstream>
+#include <streambuf>
 #include <functional>
 #include <memory>
+#include <new>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define SMUX_HAS_PMR 1
+#endif
+#endif
+
 #include "smux.h"
 
 /**
@@ -66,17 +78,189 @@ namespace smux
      */
     using read_fn = ssize_t (void* buf, size_t count);
 
+    /**
+     * \brief                   pool of fixed-size memory blocks
+     *
+     * Released blocks are kept on a free list and handed out again instead of going through
+     * the heap. Requests larger than the block size are passed to the heap directly. The pool
+     * must outlive all users of its blocks. It is not thread-safe.
+     */
+    class buffer_pool
+    {
+        public:
+            /**
+             * \brief                   ctor
+             * \param block_size        size of a single block in bytes
+             * \param max_free          maximum number of blocks kept on the free list
+             */
+            explicit buffer_pool(size_t block_size, size_t max_free = SIZE_MAX)
+                : _block_size(block_size < sizeof(node) ? sizeof(node) : block_size)
+                , _max_free(max_free)
+            {}
+
+            // sorry, no copy
+            buffer_pool(buffer_pool const&) = delete;
+            buffer_pool& operator=(buffer_pool const&) = delete;
+
+            /**
+             * \brief                   dtor
+             */
+            ~buffer_pool()
+            {
+                while(_free)
+                {
+                    node* n = _free;
+                    _free = n->next;
+                    ::operator delete(n);
+                }
+            }
+
+            /**
+             * \brief                   allocate memory
+             * \param size              number of bytes
+             * \return                  a block if size <= block_size(), heap memory otherwise
+             * \throw std::bad_alloc
+             */
+            void* allocate(size_t size)
+            {
+                if(size > _block_size)
+                    return ::operator new(size);
+                if(!_free)
+                    return ::operator new(_block_size);
+                node* n = _free;
+                _free = n->next;
+                --_free_count;
+                return n;
+            }
+
+            /**
+             * \brief                   release memory allocated with allocate()
+             * \param ptr               memory to release
+             * \param size              number of bytes passed to allocate()
+             */
+            void deallocate(void* ptr, size_t size)
+            {
+                if(size > _block_size || _free_count >= _max_free)
+                {
+                    ::operator delete(ptr);
+                    return;
+                }
+                node* n = static_cast<node*>(ptr);
+                n->next = _free;
+                _free = n;
+                ++_free_count;
+            }
+
+            /// size of a single block
+            size_t block_size() const
+            {
+                return _block_size;
+            }
+
+            /// number of blocks on the free list
+            size_t free_count() const
+            {
+                return _free_count;
+            }
+
+        private:
+            struct node
+            {
+                node* next;
+            };
+
+            size_t _block_size;
+            size_t _max_free;
+            node* _free = nullptr;
+            size_t _free_count = 0;
+    };
+
+    /**
+     * \brief                   allocator drawing from a buffer_pool
+     * \param T                 value type
+     */
+    template <class T>
+    class pool_allocator
+    {
+        public:
+            using value_type = T;
+
+            /**
+             * \brief                   ctor
+             * \param pool              pool to allocate from (must outlive the allocator)
+             */
+            pool_allocator(buffer_pool& pool) noexcept
+                : _pool(&pool)
+            {}
+
+            template <class U>
+            pool_allocator(pool_allocator<U> const& other) noexcept
+                : _pool(other.pool())
+            {}
+
+            T* allocate(size_t n)
+            {
+                return static_cast<T*>(_pool->allocate(n * sizeof(T)));
+            }
+
+            void deallocate(T* ptr, size_t n)
+            {
+                _pool->deallocate(ptr, n * sizeof(T));
+            }
+
+            /// underlying pool
+            buffer_pool* pool() const noexcept
+            {
+                return _pool;
+            }
+
+        private:
+            buffer_pool* _pool;
+    };
+
+    template <class T, class U>
+    bool operator==(pool_allocator<T> const& a, pool_allocator<U> const& b) noexcept
+    {
+        return a.pool() == b.pool();
+    }
+
+    template <class T, class U>
+    bool operator!=(pool_allocator<T> const& a, pool_allocator<U> const& b) noexcept
+    {
+        return a.pool() != b.pool();
+    }
+
     /**
      * \brief                   wrapper for a smux sender
+     * \param WriteFn           type of the write function (callable compatible with write_fn)
+     * \param Alloc             allocator for the write buffer
+     *
+     * The write function is stored by value and called through a trampoline specific to
+     * WriteFn, so lambdas and function objects are inlined into it. Use smux::sender for a
+     * type-erased std::function.
      */
-    class sender
+    template <class WriteFn, class Alloc = std::allocator<char>>
+    class basic_sender
     {
         public:
             /**
              * \brief                   ctor
              * \param buf_size          writer buffer size (must be >= 16)
+             * \param alloc             allocator for the write buffer
+             */
+            basic_sender(size_t buf_size = DEFAULT_BUF_SIZE, Alloc const& alloc = Alloc())
+                : basic_sender(WriteFn(), buf_size, alloc)
+            {}
+
+            /**
+             * \brief                   ctor
+             * \param fn                write function
+             * \param buf_size          writer buffer size (must be >= 16)
+             * \param alloc             allocator for the write buffer
              */
-            sender(size_t buf_size = DEFAULT_BUF_SIZE)
+            basic_sender(WriteFn fn, size_t buf_size = DEFAULT_BUF_SIZE, Alloc const& alloc = Alloc())
+                : _buf(alloc)
+                , _write_fn(std::move(fn))
             {
                 if(buf_size < 16)
                     throw config_error("smux requires a buffer size of at least 16 bytes");
@@ -84,10 +268,9 @@ namespace smux
 
                 // init smux config
                 smux_init(&_smux, nullptr);
-                _smux.buffer.write_buf = _buf.data();
                 _smux.buffer.write_buf_size = _buf.size();
                 _smux.buffer.write_fn = writer;
-                _smux.buffer.write_fd = reinterpret_cast<void*>(&_write_fn);
+                _rebind();
             }
 
             /**
@@ -96,11 +279,56 @@ namespace smux
              * The write function is called by smux to actually transfer data.
              * You usually want to set it.
              */
-            void set_write_fn(std::function<write_fn> fn)
+            void set_write_fn(WriteFn fn)
             {
                 _write_fn = std::move(fn);
             }
 
+            /**
+             * \brief                   enable the elastic buffer
+             * \param segment_size      size of a single segment in bytes
+             * \param max_size          maximum size of all segments (0 = unlimited)
+             * \see                     smux_config_send::elastic
+             *
+             * Data that does not fit into the write buffer is kept in segments allocated
+             * from the heap until it is written.
+             */
+            void set_elastic(size_t segment_size, size_t max_size = 0)
+            {
+                _smux.elastic.alloc_fn = allocator;
+                _smux.elastic.release_fn = releaser;
+                _smux.elastic.alloc_fd = nullptr;
+                _smux.elastic.segment_size = segment_size;
+                _smux.elastic.max_size = max_size;
+            }
+
+            /**
+             * \brief                   enable the elastic buffer with segments from a pool
+             * \param pool              pool to allocate segments from (must outlive the sender)
+             * \param max_size          maximum size of all segments (0 = unlimited)
+             *
+             * The segment size is the pool's block size.
+             */
+            void set_elastic(buffer_pool& pool, size_t max_size = 0)
+            {
+                _smux.elastic.alloc_fn = pool_allocator_fn;
+                _smux.elastic.release_fn = pool_releaser_fn;
+                _smux.elastic.alloc_fd = &pool;
+                _smux.elastic.segment_size = pool.block_size();
+                _smux.elastic.max_size = max_size;
+            }
+
+            /**
+             * \brief                   enable/disable lazy encoding
+             * \see                     smux_config_send::buffer::lazy
+             *
+             * Must only be changed while the write buffer is empty.
+             */
+            void set_lazy(bool lazy)
+            {
+                _smux.buffer.lazy = lazy;
+            }
+
             /**
              * \brief                   low-level send function
              * \see                     smux_send
@@ -112,6 +340,33 @@ namespace smux
                 return smux_send(&_smux, ch, buf, count);
             }
 
+            /**
+             * \brief                   low-level all-or-nothing send function
+             * \see                     smux_send_atomic
+             */
+            size_t send_atomic(smux_channel ch, const void *buf, size_t count)
+            {
+                return smux_send_atomic(&_smux, ch, buf, count);
+            }
+
+            /**
+             * \brief                   reserve space for in-place production of a payload
+             * \see                     smux_send_reserve
+             */
+            void* send_reserve(smux_channel ch, size_t max_len)
+            {
+                return smux_send_reserve(&_smux, ch, max_len);
+            }
+
+            /**
+             * \brief                   commit a payload produced in place
+             * \see                     smux_send_commit
+             */
+            size_t send_commit(size_t actual_len)
+            {
+                return smux_send_commit(&_smux, actual_len);
+            }
+
             /**
              * \brief                   low-level write function
              * \see                     smux_write
@@ -121,12 +376,57 @@ namespace smux
                 return smux_write(&_smux);
             }
 
+            /**
+             * \brief                   number of encoded bytes waiting to be written
+             * \see                     smux_write_pending
+             */
+            size_t write_pending() const
+            {
+                return smux_write_pending(&_smux);
+            }
+
+            /// size of the write buffer
+            size_t write_buf_size() const
+            {
+                return _buf.size();
+            }
+
+            /**
+             * \brief                   change the size of the write buffer
+             * \param buf_size          new size (must be >= 16)
+             * \return                  false if data is pending (the buffer is unchanged then)
+             * \throw config_error      if buf_size is too small
+             *
+             * Only possible while nothing is pending: the write buffer and the elastic buffer are
+             * empty, there is no reservation and no partially encoded lazy frame.
+             */
+            bool resize_write_buf(size_t buf_size)
+            {
+                if(buf_size < 16)
+                    throw config_error("smux requires a buffer size of at least 16 bytes");
+                auto const& in = _smux._internal;
+                if(in.wb_head != in.wb_tail || in.seg_first || in.rsv_len
+                        || in.lz_desc_len || in.lz_remain || in.lz_out_pos != in.lz_out_len)
+                    return false;
+                if(buf_size != _buf.size())
+                {
+                    buffer tmp(buf_size, _buf.get_allocator());
+                    _buf.swap(tmp);
+                    _smux.buffer.write_buf_size = _buf.size();
+                    _smux._internal.wb_head = _smux._internal.wb_tail = 0;
+                    _rebind();
+                }
+                return true;
+            }
+
             /**
              * \brief                   low-level write_buf function
              * \see                     smux_write_buf
-             * TODO: not yet implemented
              */
-            //size_t write_buf(void *buf, size_t count);
+            size_t write_buf(void *buf, size_t count)
+            {
+                return smux_write_buf(&_smux, buf, count);
+            }
 
             /**
              * \brief                   get the internal config
@@ -137,49 +437,134 @@ namespace smux
             }
 
             // sorry, no copy
-            sender(sender const&) = delete;
-            sender& operator=(sender const&) = delete;
-            // move invalidates _write_buf.data()
-            sender(sender&&) = delete;
-            sender& operator=(sender&&) = delete;
+            basic_sender(basic_sender const&) = delete;
+            basic_sender& operator=(basic_sender const&) = delete;
+
+            /**
+             * \brief                   move ctor
+             *
+             * Pending data moves along. Streams attached to other must be recreated. other
+             * may only be destroyed or assigned afterwards.
+             */
+            basic_sender(basic_sender&& other)
+                : _smux(other._smux)
+                , _buf(std::move(other._buf))
+                , _write_fn(std::move(other._write_fn))
+            {
+                _rebind();
+                smux_init(&other._smux, nullptr);
+            }
+
+            /**
+             * \brief                   move assignment
+             * \see                     basic_sender(basic_sender&&)
+             */
+            basic_sender& operator=(basic_sender&& other)
+            {
+                if(this != &other)
+                {
+                    smux_free(&_smux, nullptr);
+                    _smux = other._smux;
+                    _buf = std::move(other._buf);
+                    _write_fn = std::move(other._write_fn);
+                    _rebind();
+                    smux_init(&other._smux, nullptr);
+                }
+                return *this;
+            }
 
             /**
              * \brief                   dtor
              */
-            ~sender()
+            ~basic_sender()
             {
                 smux_free(&_smux, nullptr);
             }
 
         protected:
-            template<class charT, class traits, class Alloc>
-            friend class basic_ostream;
-
             // adapter for write function
             static
             ssize_t writer(void* fd, const void *buf, size_t count)
             {
-                auto& fn = *reinterpret_cast<std::function<write_fn>*>(fd);
+                auto& fn = *reinterpret_cast<WriteFn*>(fd);
                 return fn(buf, count);
             }
 
+            // adapters for segment allocation
+            static
+            void* allocator(void*, size_t size)
+            {
+                return ::operator new(size, std::nothrow);
+            }
+            static
+            void releaser(void*, void* ptr)
+            {
+                ::operator delete(ptr);
+            }
+            static
+            void* pool_allocator_fn(void* pool, size_t size)
+            {
+                try
+                {
+                    return static_cast<buffer_pool*>(pool)->allocate(size);
+                }
+                catch(std::bad_alloc const&)
+                {
+                    return nullptr;
+                }
+            }
+            static
+            void pool_releaser_fn(void* pool, void* ptr)
+            {
+                auto* p = static_cast<buffer_pool*>(pool);
+                p->deallocate(ptr, p->block_size());
+            }
+
+            // point the config to the buffer and write function of this object
+            void _rebind()
+            {
+                _smux.buffer.write_buf = _buf.data();
+                _smux.buffer.write_fd = reinterpret_cast<void*>(&_write_fn);
+            }
+
             smux_config_send _smux;
-            using buffer = std::vector<char>;
+            using buffer = std::vector<char, Alloc>;
             buffer _buf;
-            std::function<write_fn> _write_fn;
+            WriteFn _write_fn;
     };
 
+    /// sender with a type-erased write function
+    using sender = basic_sender<std::function<write_fn>>;
+
     /**
      * \brief                   wrapper for a smux receiver
+     * \param ReadFn            type of the read function (callable compatible with read_fn)
+     * \param Alloc             allocator for the read buffer
+     *
+     * \see                     basic_sender
      */
-    class receiver
+    template <class ReadFn, class Alloc = std::allocator<char>>
+    class basic_receiver
     {
         public:
             /**
              * \brief                   ctor
              * \param buf_size          reader buffer size (must be >= 16)
+             * \param alloc             allocator for the read buffer
+             */
+            basic_receiver(size_t buf_size = DEFAULT_BUF_SIZE, Alloc const& alloc = Alloc())
+                : basic_receiver(ReadFn(), buf_size, alloc)
+            {}
+
+            /**
+             * \brief                   ctor
+             * \param fn                read function
+             * \param buf_size          reader buffer size (must be >= 16)
+             * \param alloc             allocator for the read buffer
              */
-            receiver(size_t buf_size = DEFAULT_BUF_SIZE)
+            basic_receiver(ReadFn fn, size_t buf_size = DEFAULT_BUF_SIZE, Alloc const& alloc = Alloc())
+                : _buf(alloc)
+                , _read_fn(std::move(fn))
             {
                 if(buf_size < 16)
                     throw config_error("smux requires a buffer size of at least 16 bytes");
@@ -187,10 +572,9 @@ namespace smux
 
                 // init smux config
                 smux_init(nullptr, &_smux);
-                _smux.buffer.read_buf = _buf.data();
                 _smux.buffer.read_buf_size = _buf.size();
                 _smux.buffer.read_fn = reader;
-                _smux.buffer.read_fd = reinterpret_cast<void*>(&_read_fn);
+                _rebind();
             }
 
             /**
@@ -199,11 +583,20 @@ namespace smux
              * The read function is called by smux to actully read data before decoding.
              * You usually want to set it.
              */
-            void set_read_fn(std::function<read_fn> fn)
+            void set_read_fn(ReadFn fn)
             {
                 _read_fn = std::move(fn);
             }
 
+            /**
+             * \brief                   subscribe to or unsubscribe from a channel
+             * \see                     smux_subscribe
+             */
+            void subscribe(smux_channel ch, bool subscribe = true)
+            {
+                smux_subscribe(&_smux, ch, subscribe);
+            }
+
             /**
              * \brief                   low-level receive function
              * \see                     smux_recv
@@ -224,6 +617,37 @@ namespace smux
                 return smux_read(&_smux);
             }
 
+            /// size of the read buffer
+            size_t read_buf_size() const
+            {
+                return _buf.size();
+            }
+
+            /**
+             * \brief                   change the size of the read buffer
+             * \param buf_size          new size (must be >= 16)
+             * \return                  false if undecoded data is buffered (the buffer is unchanged then)
+             * \throw config_error      if buf_size is too small
+             *
+             * The decoder state is kept, so this is possible in the middle of a frame.
+             */
+            bool resize_read_buf(size_t buf_size)
+            {
+                if(buf_size < 16)
+                    throw config_error("smux requires a buffer size of at least 16 bytes");
+                if(_smux._internal.rb_head != _smux._internal.rb_tail)
+                    return false;
+                if(buf_size != _buf.size())
+                {
+                    buffer tmp(buf_size, _buf.get_allocator());
+                    _buf.swap(tmp);
+                    _smux.buffer.read_buf_size = _buf.size();
+                    _smux._internal.rb_head = _smux._internal.rb_tail = 0;
+                    _rebind();
+                }
+                return true;
+            }
+
             /**
              * \brief                   low-level read_buf function
              * \see                     smux_read_buf
@@ -242,122 +666,653 @@ namespace smux
             }
 
             // sorry, no copy
-            receiver(receiver const&) = delete;
-            receiver& operator=(receiver const&) = delete;
-            // move invalidates _write_buf.data()
-            receiver(receiver&&) = delete;
-            receiver& operator=(receiver&&) = delete;
+            basic_receiver(basic_receiver const&) = delete;
+            basic_receiver& operator=(basic_receiver const&) = delete;
+
+            /**
+             * \brief                   move ctor
+             *
+             * Buffered data and subscriptions move along. Streams and demultiplexers attached
+             * to other must be recreated. other may only be destroyed or assigned afterwards.
+             */
+            basic_receiver(basic_receiver&& other)
+                : _smux(other._smux)
+                , _buf(std::move(other._buf))
+                , _read_fn(std::move(other._read_fn))
+            {
+                _rebind();
+                smux_init(nullptr, &other._smux);
+            }
+
+            /**
+             * \brief                   move assignment
+             * \see                     basic_receiver(basic_receiver&&)
+             */
+            basic_receiver& operator=(basic_receiver&& other)
+            {
+                if(this != &other)
+                {
+                    smux_free(nullptr, &_smux);
+                    _smux = other._smux;
+                    _buf = std::move(other._buf);
+                    _read_fn = std::move(other._read_fn);
+                    _rebind();
+                    smux_init(nullptr, &other._smux);
+                }
+                return *this;
+            }
 
             /**
              * \brief                   dtor
              */
-            ~receiver()
+            ~basic_receiver()
             {
                 smux_free(nullptr, &_smux);
             }
 
         protected:
-            template<class charT, class traits, class Alloc>
-            friend class basic_istream;
-
             // adapter for read function
             static
             ssize_t reader(void* fd, void *buf, size_t count)
             {
-                auto& fn = *reinterpret_cast<std::function<read_fn>*>(fd);
+                auto& fn = *reinterpret_cast<ReadFn*>(fd);
                 return fn(buf, count);
             }
 
+            // point the config to the buffer and read function of this object
+            void _rebind()
+            {
+                _smux.buffer.read_buf = _buf.data();
+                _smux.buffer.read_fd = reinterpret_cast<void*>(&_read_fn);
+            }
+
             smux_config_recv _smux;
-            using buffer = std::vector<char>;
+            using buffer = std::vector<char, Alloc>;
             buffer _buf;
-            std::function<read_fn> _read_fn;
+            ReadFn _read_fn;
     };
 
+    /// receiver with a type-erased read function
+    using receiver = basic_receiver<std::function<read_fn>>;
+
+    template <class charT, class traits = std::char_traits<charT>, class Alloc = std::allocator<charT>>
+    class basic_demux;
+
+    template <class Conn>
+    class basic_channel;
+
     /**
      * \brief                   smux connection containing a sender and a receiver
+     * \param WriteFn           type of the write function
+     * \param ReadFn            type of the read function
+     * \param Alloc             allocator for both buffers
+     *
+     * Connections are movable, see basic_sender(basic_sender&&) for the caveats.
+     *
+     * The sender and the receiver part (including resize_write_buf() and resize_read_buf())
+     * may be used by two different threads, see smux.h. Channel handles use both parts.
      */
-    class connection : public sender, public receiver
+    template <class WriteFn = std::function<write_fn>, class ReadFn = std::function<read_fn>,
+             class Alloc = std::allocator<char>>
+    class basic_connection : public basic_sender<WriteFn, Alloc>, public basic_receiver<ReadFn, Alloc>
     {
         public:
+            using sender_type = basic_sender<WriteFn, Alloc>;
+            using receiver_type = basic_receiver<ReadFn, Alloc>;
+
             /**
              * \brief                   ctor
              * \param write_buf_size    writer buffer size (must be >= 16)
              * \param read_buf_size     reader buffer size (must be >= 16)
+             * \param alloc             allocator for both buffers
              */
-            connection(size_t write_buf_size = DEFAULT_BUF_SIZE, size_t read_buf_size = DEFAULT_BUF_SIZE)
-                : sender(write_buf_size)
-                , receiver(read_buf_size)
+            basic_connection(size_t write_buf_size = DEFAULT_BUF_SIZE, size_t read_buf_size = DEFAULT_BUF_SIZE,
+                    Alloc const& alloc = Alloc())
+                : basic_sender<WriteFn, Alloc>(write_buf_size, alloc)
+                , basic_receiver<ReadFn, Alloc>(read_buf_size, alloc)
             {}
-    };
 
-    /**
-     * \brief                   stream to send data
-     */
-    template <class charT, class traits = std::char_traits<charT>, class Alloc = std::allocator<charT>>
-    class basic_ostream : public std::basic_ostream<charT, traits>
-    {
-        public:
             /**
              * \brief                   ctor
-             * \param smux              a smux sender to send on
-             * \param ch                initial channel (can be changed with channel())
+             * \param write_fn          write function
+             * \param read_fn           read function
+             * \param write_buf_size    writer buffer size (must be >= 16)
+             * \param read_buf_size     reader buffer size (must be >= 16)
+             * \param alloc             allocator for both buffers
              */
-            basic_ostream(sender& smux, smux_channel ch = 0)
-                : std::basic_ostream<charT, traits>(&_sb) // this is safe according to the standard
-                , _sb(&smux._smux, ch)
-            {
-            }
+            basic_connection(WriteFn write_fn, ReadFn read_fn,
+                    size_t write_buf_size = DEFAULT_BUF_SIZE, size_t read_buf_size = DEFAULT_BUF_SIZE,
+                    Alloc const& alloc = Alloc())
+                : basic_sender<WriteFn, Alloc>(std::move(write_fn), write_buf_size, alloc)
+                , basic_receiver<ReadFn, Alloc>(std::move(read_fn), read_buf_size, alloc)
+            {}
 
             /**
-             * \brief                   set the channel to send on
-             * \param ch                new channel
+             * \brief                   move ctor
+             * \see                     basic_sender(basic_sender&&)
              *
-             * Flushes before setting the channel.
+             * Channel handles opened on other must be reopened.
              */
-            void channel(smux_channel ch)
+            basic_connection(basic_connection&& other)
+                : basic_sender<WriteFn, Alloc>(std::move(other))
+                , basic_receiver<ReadFn, Alloc>(std::move(other))
+                , _channels(std::move(other._channels))
             {
-                _sb.sync();
-                _sb._ch = ch;
+                if(_channels)
+                    _channels->demux->attach(*this);
             }
 
             /**
-             * \brief                   get the current channel
-             * \return                  current channel
+             * \brief                   move assignment
+             * \see                     basic_connection(basic_connection&&)
              */
-            smux_channel channel() const
+            basic_connection& operator=(basic_connection&& other)
             {
-                return _sb._ch;
+                basic_sender<WriteFn, Alloc>::operator=(std::move(other));
+                basic_receiver<ReadFn, Alloc>::operator=(std::move(other));
+                _channels = std::move(other._channels);
+                if(_channels)
+                    _channels->demux->attach(*this);
+                return *this;
             }
 
-        private:
-            struct sendbuf : std::basic_stringbuf<charT, traits, Alloc>
+            /**
+             * \brief                   open a channel handle
+             * \param ch                channel
+             * \param queue_size        capacity of the channel's send queue in bytes
+             * \return                  handle to the channel
+             *
+             * The first call routes all received data through a demultiplexer: from then on,
+             * only channels opened by this function are received. Handles refer to this object
+             * and must be reopened if it is moved.
+             */
+            basic_channel<basic_connection> open_channel(smux_channel ch, size_t queue_size = 256)
             {
-                sendbuf(smux_config_send* smux, smux_channel ch)
-                    : _smux(smux), _ch(ch)
-                {}
+                if(!_channels)
+                    _channels.reset(new channel_table(*this));
+                _channels->demux->channel(ch); // subscribe
+                _channels->tx[ch].cap = queue_size;
+                _channels->tx[ch].buf.reserve(queue_size);
+                return basic_channel<basic_connection>(*this, ch);
+            }
 
-                int sync() override
+        protected:
+            template <class Conn>
+            friend class basic_channel;
+
+            // per channel send queue, holds buf[head..]
+            struct txqueue
+            {
+                std::vector<char> buf;
+                size_t head = 0;
+                size_t cap = 0;
+
+                size_t size() const
+                {
+                    return buf.size() - head;
+                }
+
+                bool empty() const
+                {
+                    return head == buf.size();
+                }
+
+                const char* data() const
                 {
-                    auto data = this->str();
-                    size_t ret = 0;
-                    while(data.size() > 0)
+                    return buf.data() + head;
+                }
+
+                void append(const char* p, size_t n)
+                {
+                    // move the queued data to the front only when the end is reached
+                    if(head && buf.size() + n > cap)
                     {
-                        // TODO: byte order
-                        ret = smux_send(_smux, _ch, reinterpret_cast<const void*>(data.data()), data.size()*sizeof(charT));
-                        if(ret <= 0) break;
-                        data.erase(0, ret); // remove the part that was written
-                        ret = smux_write(_smux);
-                        if(ret <= 0) break;
+                        buf.erase(buf.begin(), buf.begin() + head);
+                        head = 0;
                     }
-                    // only keep data that could not be written
-                    this->str(data);
+                    buf.insert(buf.end(), p, p + n);
+                }
+
+                void consume(size_t n)
+                {
+                    head += n;
+                    if(head == buf.size())
+                    {
+                        buf.clear();
+                        head = 0;
+                    }
+                }
+            };
+
+            // state of the channels opened by open_channel()
+            struct channel_table
+            {
+                std::unique_ptr<basic_demux<char>> demux;
+                txqueue tx[smux_channel_max + 1];
+
+                channel_table(receiver_type& r)
+                    : demux(new basic_demux<char>(r))
+                {}
+            };
 
+            std::unique_ptr<channel_table> _channels;
+    };
+
+    /// connection with type-erased read and write functions
+    using connection = basic_connection<>;
+
+    /// connection with type-erased functions and buffers from a buffer_pool
+    using pooled_connection = basic_connection<std::function<write_fn>, std::function<read_fn>,
+          pool_allocator<char>>;
+
+#ifdef SMUX_HAS_PMR
+    namespace pmr
+    {
+        /// sender with buffers from a std::pmr::memory_resource
+        using sender = basic_sender<std::function<write_fn>, std::pmr::polymorphic_allocator<char>>;
+        /// receiver with buffers from a std::pmr::memory_resource
+        using receiver = basic_receiver<std::function<read_fn>, std::pmr::polymorphic_allocator<char>>;
+        /// connection with buffers from a std::pmr::memory_resource
+        using connection = basic_connection<std::function<write_fn>, std::function<read_fn>,
+              std::pmr::polymorphic_allocator<char>>;
+    }
+#endif
+
+    /**
+     * \brief                   header-only codec with compile-time protocol settings
+     * \param Esc               escape character (default: x01)
+     * \param Capacity          size of the write and the read buffer (power of two)
+     * \param SizeBytes         width of the size field in frame headers (default: 2)
+     *
+     * Implements the same wire format as the C library (\see smux_send, \see smux_recv), but
+     * all protocol settings and buffer sizes are template parameters, so the compiler can
+     * fold the ring buffer arithmetic into masks and inline the read and write functions,
+     * which are passed as arbitrary callables. Both sides of a connection must agree on Esc
+     * and SizeBytes; only the default SizeBytes is compatible with the C library.
+     *
+     * Unlike the C library, the buffers are used up to their full capacity.
+     */
+    template <char Esc = '\x01', size_t Capacity = DEFAULT_BUF_SIZE, size_t SizeBytes = 2>
+    class basic_codec
+    {
+            static_assert(Capacity >= 16 && (Capacity & (Capacity - 1)) == 0,
+                    "smux requires a power of two buffer size of at least 16 bytes");
+            static_assert(SizeBytes >= 1 && SizeBytes <= 4, "size field must have 1 to 4 bytes");
+
+        public:
+            static constexpr char esc = Esc; ///< escape character
+            static constexpr size_t capacity = Capacity; ///< buffer size
+            static constexpr size_t header_bytes = 2 + SizeBytes; ///< escape, channel and size
+            static constexpr size_t max_size = (size_t(1) << (SizeBytes * 8 - 1) << 1) - 1; ///< frame size limit
+
+            /**
+             * \brief                   send data over a virtual channel
+             * \see                     smux_send
+             */
+            size_t send(smux_channel ch, const void *buf, size_t count)
+            {
+                const char* in = static_cast<const char*>(buf);
+                size_t head = _whead;
+                size_t size_field = 0;
+                size_t copied = 0;
+
+                if(count > max_size)
+                    count = max_size;
+                if(count == 0)
                     return 0;
+
+                // header (escape char, channel and space for size field)
+                if(ch != 0)
+                {
+                    if(Capacity - (head - _wtail) < header_bytes + 1)
+                        return 0;
+                    _wb[_mask(head++)] = Esc;
+                    _wb[_mask(head++)] = static_cast<char>(ch);
+                    size_field = head;
+                    head += SizeBytes;
+                }
+
+                // payload
+                for(; copied < count; ++copied)
+                {
+                    size_t room = Capacity - (head - _wtail);
+                    char c = in[copied];
+                    if(c == Esc)
+                    {
+                        if(room < 2)
+                            break;
+                        _wb[_mask(head++)] = Esc;
+                        _wb[_mask(head++)] = 0;
+                    } else
+                    {
+                        if(room < 1)
+                            break;
+                        _wb[_mask(head++)] = c;
+                    }
+                }
+
+                // size field (big endian)
+                if(ch != 0)
+                {
+                    for(size_t i = 0; i < SizeBytes; ++i)
+                        _wb[_mask(size_field + i)] = static_cast<char>(copied >> (8 * (SizeBytes - 1 - i)));
+                }
+
+                _whead = head;
+                return copied;
+            }
+
+            /**
+             * \brief                   receive data from a virtual channel
+             * \see                     smux_recv
+             */
+            size_t recv(smux_channel *ch, void *buf, size_t count)
+            {
+                char* out = static_cast<char*>(buf);
+                size_t tail = _rtail;
+                size_t copied = 0;
+
+                *ch = _recv_ch;
+                while(copied < count && (_recv_ch == 0 || _recv_chars > 0) && tail != _rhead)
+                {
+                    char c = _rb[_mask(tail)];
+                    if(c != Esc) // normal case
+                    {
+                        out[copied++] = c;
+                        ++tail;
+                        if(_recv_ch != 0)
+                            --_recv_chars;
+                        continue;
+                    }
+
+                    // another char to decode esc seq?
+                    if(_rhead - tail < 2)
+                        break;
+                    char next = _rb[_mask(tail + 1)];
+                    if(next == 0) // just escape of esc char
+                    {
+                        out[copied++] = Esc;
+                        tail += 2;
+                        if(_recv_ch != 0)
+                            --_recv_chars;
+                        continue;
+                    }
+
+                    // channel information: complete, and no payload of another channel copied yet?
+                    if(_rhead - tail < header_bytes || copied > 0)
+                        break;
+                    size_t size = 0;
+                    for(size_t i = 0; i < SizeBytes; ++i)
+                        size = (size << 8) | static_cast<unsigned char>(_rb[_mask(tail + 2 + i)]);
+                    _recv_ch = static_cast<smux_channel>(next);
+                    _recv_chars = size;
+                    tail += header_bytes;
+                    *ch = _recv_ch;
+                }
+
+                _rtail = tail;
+                if(_recv_chars == 0)
+                    _recv_ch = 0; // ensure correct channel if read everything
+                return copied;
+            }
+
+            /**
+             * \brief                   write multiplexed data
+             * \param fn                callable compatible with smux::write_fn
+             * \see                     smux_write
+             */
+            template <class WriteFn>
+            ssize_t write(WriteFn&& fn)
+            {
+                ssize_t ret = 0;
+                while(_whead != _wtail)
+                {
+                    size_t tail = _mask(_wtail);
+                    size_t count = _whead - _wtail;
+                    if(count > Capacity - tail)
+                        count = Capacity - tail;
+
+                    ret = fn(static_cast<const void*>(_wb + tail), count);
+                    if(ret <= 0)
+                        break;
+                    _wtail += static_cast<size_t>(ret) > count ? count : static_cast<size_t>(ret);
+                }
+                if(ret < 0) // error?
+                    return ret;
+                return _whead - _wtail;
+            }
+
+            /**
+             * \brief                   extract multiplexed data to an external buffer
+             * \see                     smux_write_buf
+             */
+            size_t write_buf(void *buf, size_t count)
+            {
+                char* out = static_cast<char*>(buf);
+                size_t copied = 0;
+                while(copied < count && _whead != _wtail)
+                {
+                    size_t tail = _mask(_wtail);
+                    size_t part = _whead - _wtail;
+                    if(part > Capacity - tail)
+                        part = Capacity - tail;
+                    if(part > count - copied)
+                        part = count - copied;
+                    std::memcpy(out + copied, _wb + tail, part);
+                    _wtail += part;
+                    copied += part;
+                }
+                return copied;
+            }
+
+            /**
+             * \brief                   read multiplexed data
+             * \param fn                callable compatible with smux::read_fn
+             * \see                     smux_read
+             */
+            template <class ReadFn>
+            ssize_t read(ReadFn&& fn)
+            {
+                ssize_t ret = 0;
+                while(_rhead - _rtail < Capacity)
+                {
+                    size_t head = _mask(_rhead);
+                    size_t count = Capacity - (_rhead - _rtail);
+                    if(count > Capacity - head)
+                        count = Capacity - head;
+
+                    ret = fn(static_cast<void*>(_rb + head), count);
+                    if(ret <= 0)
+                        break;
+                    _rhead += static_cast<size_t>(ret) > count ? count : static_cast<size_t>(ret);
+                    // more bytes available?
+                    if(static_cast<size_t>(ret) <= count)
+                        break;
+                }
+                if(ret < 0) // error?
+                    return ret;
+                return Capacity - (_rhead - _rtail);
+            }
+
+            /**
+             * \brief                   read multiplexed data from an external buffer
+             * \see                     smux_read_buf
+             */
+            size_t read_buf(const void *buf, size_t count)
+            {
+                const char* in = static_cast<const char*>(buf);
+                size_t copied = 0;
+                while(copied < count && _rhead - _rtail < Capacity)
+                {
+                    size_t head = _mask(_rhead);
+                    size_t part = Capacity - (_rhead - _rtail);
+                    if(part > Capacity - head)
+                        part = Capacity - head;
+                    if(part > count - copied)
+                        part = count - copied;
+                    std::memcpy(_rb + head, in + copied, part);
+                    _rhead += part;
+                    copied += part;
+                }
+                return copied;
+            }
+
+        private:
+            static size_t _mask(size_t i)
+            {
+                return i & (Capacity - 1);
+            }
+
+            // free-running indices, only masked on access
+            size_t _whead = 0, _wtail = 0;
+            size_t _rhead = 0, _rtail = 0;
+            smux_channel _recv_ch = 0;
+            size_t _recv_chars = 0;
+            char _wb[Capacity];
+            char _rb[Capacity];
+    };
+
+    /// codec with default protocol settings (compatible with the C library)
+    using codec = basic_codec<>;
+
+    /**
+     * \brief                   stream to send data
+     */
+    template <class charT, class traits = std::char_traits<charT>, class Alloc = std::allocator<charT>>
+    class basic_ostream : public std::basic_ostream<charT, traits>
+    {
+        public:
+            /**
+             * \brief                   ctor
+             * \param smux              a smux sender to send on
+             * \param ch                initial channel (can be changed with channel())
+             */
+            template <class WriteFn, class A>
+            basic_ostream(basic_sender<WriteFn, A>& smux, smux_channel ch = 0)
+                : std::basic_ostream<charT, traits>(&_sb) // this is safe according to the standard
+                , _sb(smux.smux(), ch)
+            {
+            }
+
+            /**
+             * \brief                   set the channel to send on
+             * \param ch                new channel
+             *
+             * Flushes before setting the channel.
+             */
+            void channel(smux_channel ch)
+            {
+                _sb.sync();
+                _sb._ch = ch;
+            }
+
+            /**
+             * \brief                   get the current channel
+             * \return                  current channel
+             */
+            smux_channel channel() const
+            {
+                return _sb._ch;
+            }
+
+        private:
+            /*
+             * Bulk writes are encoded by smux directly from the caller's buffer. Only small
+             * writes (e.g., formatted output) are collected in a put area, which is allocated
+             * on first use.
+             */
+            struct sendbuf : std::basic_streambuf<charT, traits>
+            {
+                enum { PUT_AREA_SIZE = 256 }; // characters
+
+                using int_type = typename traits::int_type;
+
+                sendbuf(smux_config_send* smux, smux_channel ch)
+                    : _smux(smux), _ch(ch)
+                {}
+
+                ~sendbuf()
+                {
+                    sync();
+                }
+
+                int_type overflow(int_type c) override
+                {
+                    if(_buf.empty())
+                    {
+                        _buf.resize(PUT_AREA_SIZE);
+                        this->setp(_buf.data(), _buf.data() + _buf.size());
+                    } else if(!_flush() && this->pptr() == this->epptr())
+                    {
+                        return traits::eof();
+                    }
+
+                    if(!traits::eq_int_type(c, traits::eof()))
+                    {
+                        *this->pptr() = traits::to_char_type(c);
+                        this->pbump(1);
+                    }
+                    return traits::not_eof(c);
+                }
+
+                std::streamsize xsputn(const charT* s, std::streamsize n) override
+                {
+                    // small writes go to the put area
+                    if(n < PUT_AREA_SIZE)
+                        return std::basic_streambuf<charT, traits>::xsputn(s, n);
+
+                    // fast path: keep the order and send directly
+                    if(!_flush())
+                        return 0;
+                    return _send(s, n);
+                }
+
+                int sync() override
+                {
+                    if(!_flush())
+                        return -1;
+                    return smux_write(_smux) < 0 ? -1 : 0;
+                }
+
+                // send the put area, keep what could not be sent
+                bool _flush()
+                {
+                    std::streamsize pending = this->pptr() - this->pbase();
+                    if(pending == 0)
+                        return true;
+
+                    std::streamsize sent = _send(this->pbase(), pending);
+                    traits::move(this->pbase(), this->pbase() + sent, pending - sent);
+                    this->setp(this->pbase(), this->epptr());
+                    this->pbump(static_cast<int>(pending - sent));
+                    return sent == pending;
+                }
+
+                // encode characters into the smux buffer, write out if it runs full
+                std::streamsize _send(const charT* s, std::streamsize n)
+                {
+                    // TODO: byte order
+                    const char* data = reinterpret_cast<const char*>(s);
+                    size_t count = n * sizeof(charT);
+                    size_t done = 0;
+                    bool written = false;
+                    while(done < count)
+                    {
+                        size_t ret = smux_send(_smux, _ch, data + done, count - done);
+                        done += ret;
+                        if(ret > 0)
+                            written = false;
+                        else if(written || smux_write(_smux) < 0)
+                            break; // no space, writing did not help
+                        else
+                            written = true;
+                    }
+                    return done / sizeof(charT);
                 }
 
                 smux_config_send* _smux;
                 smux_channel _ch;
+                std::vector<charT, Alloc> _buf; // put area
             } _sb;
     };
 
@@ -372,9 +1327,10 @@ namespace smux
              * \brief                   ctor
              * \param smux              a smux receiver to receive from
              */
-            basic_istream(receiver& smux)
+            template <class ReadFn, class A>
+            basic_istream(basic_receiver<ReadFn, A>& smux)
                 : std::basic_istream<charT, traits>(&_rb) // this is safe according to the standard
-                , _rb(&smux._smux)
+                , _rb(smux.smux())
             {
             }
 
@@ -466,8 +1422,575 @@ namespace smux
             } _rb;
     };
 
+    /**
+     * \brief                   demultiplexing reader with one stream per channel
+     *
+     * Unlike basic_istream, which delivers all channels through a single stream, this class
+     * owns a separate buffered stream for each channel requested by channel(). A single
+     * decode pass (pump()) distributes the received data to the buffers of all channels, so
+     * each stream can be read independently without interleaving logic. Only the requested
+     * channels are subscribed; data of other channels is skipped by smux.
+     *
+     * Data of a channel is buffered until it is read from its stream, so all streams should
+     * be read regularly.
+     */
+    template <class charT, class traits, class Alloc>
+    class basic_demux
+    {
+        public:
+            using stream_type = std::basic_istream<charT, traits>;
+
+            /**
+             * \brief                   ctor
+             * \param smux              a smux receiver to receive from
+             */
+            template <class ReadFn, class A>
+            basic_demux(basic_receiver<ReadFn, A>& smux)
+                : _smux(smux.smux())
+            {
+                _scratch.resize(_smux->buffer.read_buf_size);
+                for(unsigned ch = smux_channel_min; ch <= smux_channel_max; ++ch)
+                    smux_subscribe(_smux, static_cast<smux_channel>(ch), false);
+            }
+
+            /**
+             * \brief                   get the stream of a channel
+             * \param ch                channel
+             * \return                  stream delivering the data of ch
+             *
+             * The channel is subscribed on the first call.
+             */
+            stream_type& channel(smux_channel ch)
+            {
+                auto& c = _channels[ch];
+                if(!c)
+                {
+                    c.reset(new chan(*this));
+                    smux_subscribe(_smux, ch, true);
+                }
+                return c->is;
+            }
+
+            /**
+             * \brief                   read and decode available data
+             * \return                  true if any data has been read or decoded
+             *
+             * Called by the streams whenever their buffer runs empty, but can also be called
+             * explicitly to fill the buffers of all channels.
+             */
+            bool pump()
+            {
+                unsigned rb_head = _smux->_internal.rb_head;
+                if(smux_read(_smux) < 0)
+                    return false; // TODO: signal error to streams
+                bool progress = rb_head != _smux->_internal.rb_head;
+                return decode() || progress;
+            }
+
+            /**
+             * \brief                   decode data already read without reading more
+             * \return                  true if any data has been decoded
+             */
+            bool decode()
+            {
+                bool progress = false;
+                size_t ret;
+                smux_channel ch;
+                // TODO: byte order
+                while((ret = smux_recv(_smux, &ch, _scratch.data(), _scratch.size() * sizeof(charT))) > 0)
+                {
+                    progress = true;
+                    if(_channels[ch])
+                        _channels[ch]->sb.append(_scratch.data(), ret / sizeof(charT));
+                }
+                return progress;
+            }
+
+            /**
+             * \brief                   view buffered data of a channel without copying it
+             * \param ch                channel (opened with channel())
+             * \param n                 number of characters
+             * \param align             alignment of the returned pointer in bytes (at most
+             *                          alignof(std::max_align_t))
+             * \return                  the next n characters of ch or nullptr if fewer are
+             *                          buffered
+             *
+             * Never reads or decodes. The characters stay buffered until consume() is called;
+             * the pointer is valid until the next decode.
+             */
+            const charT* peek(smux_channel ch, size_t n, size_t align = 1)
+            {
+                return _channels[ch]->sb.peek(n, align);
+            }
+
+            /**
+             * \brief                   drop buffered data of a channel
+             * \param ch                channel (opened with channel())
+             * \param n                 number of characters (at most the number buffered)
+             */
+            void consume(smux_channel ch, size_t n)
+            {
+                _channels[ch]->sb.consume(n);
+            }
+
+            /**
+             * \brief                   attach to another receiver, e.g. after a move
+             * \param smux              receiver to receive from (subscriptions are not changed)
+             */
+            template <class ReadFn, class A>
+            void attach(basic_receiver<ReadFn, A>& smux)
+            {
+                _smux = smux.smux();
+            }
+
+            // sorry, no copy (streams refer to this object)
+            basic_demux(basic_demux const&) = delete;
+            basic_demux& operator=(basic_demux const&) = delete;
+
+        private:
+            struct chanbuf : std::basic_streambuf<charT, traits>
+            {
+                using int_type = typename traits::int_type;
+
+                chanbuf(basic_demux& demux)
+                    : _demux(demux)
+                {}
+
+                // make data available for reading
+                void append(const charT* s, size_t n)
+                {
+                    size_t begin = this->gptr() - this->eback();
+                    size_t end = this->egptr() - this->eback();
+                    if(end + n > _buf.size())
+                    {
+                        // move unread data to front, grow if still too small
+                        traits::move(_buf.data(), _buf.data() + begin, end - begin);
+                        end -= begin;
+                        begin = 0;
+                        if(end + n > _buf.size())
+                            _buf.resize(end + n);
+                    }
+                    traits::copy(_buf.data() + end, s, n);
+                    this->setg(_buf.data(), _buf.data() + begin, _buf.data() + end + n);
+                }
+
+                // contiguous unread data, moved to the front of the buffer if misaligned
+                const charT* peek(size_t n, size_t align)
+                {
+                    size_t avail = this->egptr() - this->gptr();
+                    if(avail < n)
+                        return nullptr;
+                    if(reinterpret_cast<uintptr_t>(this->gptr()) % align)
+                    {
+                        traits::move(_buf.data(), this->gptr(), avail);
+                        this->setg(_buf.data(), _buf.data(), _buf.data() + avail);
+                    }
+                    return this->gptr();
+                }
+
+                void consume(size_t n)
+                {
+                    this->gbump(static_cast<int>(n));
+                }
+
+                int_type underflow() override
+                {
+                    while(this->gptr() == this->egptr())
+                    {
+                        if(!_demux.pump())
+                            return traits::eof();
+                    }
+                    return traits::to_int_type(*this->gptr());
+                }
+
+                std::streamsize xsgetn(charT* s, std::streamsize n) override
+                {
+                    std::streamsize done = 0;
+                    while(done < n)
+                    {
+                        std::streamsize avail = this->egptr() - this->gptr();
+                        if(avail == 0)
+                        {
+                            if(!_demux.pump())
+                                break;
+                            continue;
+                        }
+                        if(avail > n - done)
+                            avail = n - done;
+                        traits::copy(s + done, this->gptr(), avail);
+                        this->gbump(static_cast<int>(avail));
+                        done += avail;
+                    }
+                    return done;
+                }
+
+                std::streamsize showmanyc() override
+                {
+                    return this->egptr() - this->gptr();
+                }
+
+                basic_demux& _demux;
+                std::vector<charT, Alloc> _buf;
+            };
+
+            // per channel buffer and stream
+            struct chan
+            {
+                chanbuf sb;
+                stream_type is;
+
+                chan(basic_demux& demux)
+                    : sb(demux), is(&sb)
+                {}
+            };
+
+            smux_config_recv* _smux;
+            std::vector<charT, Alloc> _scratch; // decode buffer
+            std::unique_ptr<chan> _channels[smux_channel_max + 1];
+    };
+
     using ostream = basic_ostream<char>;
     using istream = basic_istream<char>;
+    using demux = basic_demux<char>;
+
+    /**
+     * \brief                   handle to a channel of a connection
+     * \param Conn              connection type (an instance of basic_connection)
+     *
+     * Created by basic_connection::open_channel(). Data sent through a handle is collected in
+     * a per-channel send queue and passed to smux as a single frame when the queue is full or
+     * flush() is called, independently of other channels. Received data is buffered per
+     * channel by the connection's demultiplexer.
+     *
+     * Handles are cheap to copy; all copies share the queues of the connection.
+     */
+    template <class Conn>
+    class basic_channel
+    {
+        public:
+            /**
+             * \brief                   ctor
+             * \param conn              connection with the channel opened
+             * \param ch                channel
+             */
+            basic_channel(Conn& conn, smux_channel ch)
+                : _conn(&conn)
+                , _ch(ch)
+            {}
+
+            /// channel number
+            smux_channel id() const
+            {
+                return _ch;
+            }
+
+            /**
+             * \brief                   send data, writing queued data as needed
+             * \param buf               data
+             * \param count             number of bytes
+             * \retval >=0              number of bytes sent (less than count only on error)
+             *
+             * The data is queued, so flush() must be called to send it.
+             */
+            size_t send(const void* buf, size_t count)
+            {
+                auto* p = static_cast<const char*>(buf);
+                size_t done = 0;
+                while(done < count)
+                {
+                    done += try_send(p + done, count - done);
+                    if(done < count && !flush())
+                        break;
+                }
+                return done;
+            }
+
+            /**
+             * \brief                   queue as much data as possible without writing
+             * \param buf               data
+             * \param count             number of bytes
+             * \return                  number of bytes queued
+             */
+            size_t try_send(const void* buf, size_t count)
+            {
+                auto& q = _queue();
+                if(q.size() + count > q.cap && !q.empty())
+                    _push();
+                if(q.empty() && count >= q.cap)
+                {
+                    // too large to be queued, pass directly
+                    ssize_t ret = _conn->send(_ch, buf, count);
+                    return ret < 0 ? 0 : static_cast<size_t>(ret);
+                }
+                size_t n = q.cap - q.size();
+                if(n > count)
+                    n = count;
+                q.append(static_cast<const char*>(buf), n);
+                return n;
+            }
+
+            /**
+             * \brief                   send queued data and write everything out
+             * \retval true             everything has been written
+             * \retval false            the write function failed or made no progress
+             */
+            bool flush()
+            {
+                auto& q = _queue();
+                size_t last = static_cast<size_t>(-1);
+                for(;;)
+                {
+                    _push();
+                    ssize_t ret = _conn->write();
+                    if(ret < 0)
+                        return false;
+                    size_t left = static_cast<size_t>(ret) + q.size();
+                    if(left == 0)
+                        return true;
+                    if(left >= last) // no progress
+                        return false;
+                    last = left;
+                }
+            }
+
+            /**
+             * \brief                   receive data, reading from the connection as needed
+             * \param buf               buffer
+             * \param count             capacity of buf
+             * \return                  number of received bytes (0 if the read function failed
+             *                          or made no progress)
+             *
+             * Blocks only if the read function blocks.
+             */
+            size_t recv(void* buf, size_t count)
+            {
+                auto& d = *_conn->_channels->demux;
+                auto* sb = d.channel(_ch).rdbuf();
+                while(sb->in_avail() <= 0)
+                {
+                    if(!d.pump())
+                        return 0;
+                }
+                return try_recv(buf, count);
+            }
+
+            /**
+             * \brief                   receive data already read from the connection
+             * \param buf               buffer
+             * \param count             capacity of buf
+             * \return                  number of received bytes
+             *
+             * Never calls the read function.
+             */
+            size_t try_recv(void* buf, size_t count)
+            {
+                auto& d = *_conn->_channels->demux;
+                auto* sb = d.channel(_ch).rdbuf();
+                if(sb->in_avail() <= 0)
+                    d.decode();
+                std::streamsize n = sb->in_avail();
+                if(n <= 0)
+                    return 0;
+                if(static_cast<size_t>(n) > count)
+                    n = static_cast<std::streamsize>(count);
+                return static_cast<size_t>(sb->sgetn(static_cast<char*>(buf), n));
+            }
+
+            /**
+             * \brief                   view received data without copying it
+             * \param count             number of bytes
+             * \param align             alignment of the returned pointer in bytes (at most
+             *                          alignof(std::max_align_t))
+             * \return                  the next count bytes of the channel or nullptr if
+             *                          fewer have been received
+             *
+             * Decodes data already read from the connection if necessary, but never calls the
+             * read function. The bytes stay buffered until consume() is called. The pointer is
+             * valid until the next receive call on any channel of the connection.
+             */
+            const void* peek(size_t count, size_t align = 1)
+            {
+                auto& d = *_conn->_channels->demux;
+                const char* p = d.peek(_ch, count, align);
+                if(!p && d.decode())
+                    p = d.peek(_ch, count, align);
+                return p;
+            }
+
+            /**
+             * \brief                   drop received data, e.g. after peek()
+             * \param count             number of bytes (at most readable())
+             */
+            void consume(size_t count)
+            {
+                _conn->_channels->demux->consume(_ch, count);
+            }
+
+            /**
+             * \brief                   wait until data has been received, reading from the
+             *                          connection as needed
+             * \param count             number of bytes
+             * \retval true             at least count bytes are ready for peek()
+             * \retval false            the read function failed or made no progress
+             */
+            bool wait_readable(size_t count)
+            {
+                auto& d = *_conn->_channels->demux;
+                while(readable() < count)
+                {
+                    if(!d.pump())
+                        return false;
+                }
+                return true;
+            }
+
+            /// number of received bytes ready for try_recv()
+            size_t readable() const
+            {
+                std::streamsize n = _conn->_channels->demux->channel(_ch).rdbuf()->in_avail();
+                return n > 0 ? static_cast<size_t>(n) : 0;
+            }
+
+            /// free space in the send queue
+            size_t writable() const
+            {
+                auto& q = _conn->_channels->tx[_ch];
+                return q.cap - q.size();
+            }
+
+            /// number of bytes in the send queue
+            size_t pending() const
+            {
+                return _conn->_channels->tx[_ch].size();
+            }
+
+        private:
+            typename Conn::txqueue& _queue()
+            {
+                return _conn->_channels->tx[_ch];
+            }
+
+            // pass the queue to smux as far as possible
+            void _push()
+            {
+                auto& q = _queue();
+                if(q.empty())
+                    return;
+                ssize_t ret = _conn->send(_ch, q.data(), q.size());
+                if(ret > 0)
+                    q.consume(static_cast<size_t>(ret));
+            }
+
+            Conn* _conn;
+            smux_channel _ch;
+    };
+
+    /// handle to a channel of a smux::connection
+    using channel = basic_channel<connection>;
+
+    /**
+     * \brief                   channel transporting messages of a fixed-layout type
+     * \param T                 message type (trivially copyable, at most 65535 bytes)
+     * \param Conn              connection type (an instance of basic_connection)
+     *
+     * Each message is sent as a single frame with smux_send_atomic(), so it is never split
+     * by the sender. Received messages are delivered as references into the channel's buffer
+     * of the demultiplexer (\see basic_channel::peek), so no per-message reassembly is
+     * necessary. The bytes are still copied twice on their way there: smux_recv() decodes
+     * them from the read ring into the demultiplexer's decode buffer, which is then appended
+     * to the channel's buffer.
+     *
+     * The channel is opened with basic_connection::open_channel() and must not be used
+     * through other handles at the same time.
+     */
+    template <class T, class Conn = connection>
+    class typed_channel
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+        static_assert(sizeof(T) <= 65535, "T exceeds the maximum frame size");
+        static_assert(alignof(T) <= alignof(std::max_align_t), "T must not be over-aligned");
+
+        public:
+            /**
+             * \brief                   ctor
+             * \param conn              connection
+             * \param ch                channel
+             */
+            typed_channel(Conn& conn, smux_channel ch)
+                : _conn(&conn)
+                , _ch(conn.open_channel(ch))
+            {}
+
+            /**
+             * \brief                   send a message without writing
+             * \param msg               message
+             * \retval true             the message has been queued
+             * \retval false            not enough space
+             */
+            bool try_send(T const& msg)
+            {
+                return _conn->send_atomic(_ch.id(), &msg, sizeof(T)) == sizeof(T);
+            }
+
+            /**
+             * \brief                   send a message, writing queued data as needed
+             * \param msg               message
+             * \retval true             the message has been queued
+             * \retval false            the write function failed or made no progress, or the
+             *                          message does not fit into the empty send buffers
+             */
+            bool send(T const& msg)
+            {
+                if(try_send(msg))
+                    return true;
+                // once everything is written, the message fits or never will
+                return _ch.flush() && try_send(msg);
+            }
+
+            /**
+             * \brief                   get the next message already read from the connection
+             * \return                  the message (valid until the next receive call on any
+             *                          channel of the connection) or nullptr if none is complete
+             *
+             * Never calls the read function.
+             */
+            T const* try_recv()
+            {
+                auto* msg = static_cast<T const*>(_ch.peek(sizeof(T), alignof(T)));
+                if(msg)
+                    _ch.consume(sizeof(T));
+                return msg;
+            }
+
+            /**
+             * \brief                   get the next message, reading from the connection as needed
+             * \return                  the message (valid until the next receive call on any
+             *                          channel of the connection) or nullptr if the read function
+             *                          failed or made no progress
+             */
+            T const* recv()
+            {
+                if(!_ch.wait_readable(sizeof(T)))
+                    return nullptr;
+                return try_recv();
+            }
+
+            /// number of complete messages ready for try_recv() without decoding more
+            size_t readable() const
+            {
+                return _ch.readable() / sizeof(T);
+            }
+
+            /// channel handle used by this object
+            basic_channel<Conn>& handle()
+            {
+                return _ch;
+            }
+
+        private:
+            Conn* _conn;
+            basic_channel<Conn> _ch;
+    };
 
 } // namespace smux
 
@@ -0,0 +1,531 @@
+/// \file smux_coro.hpp
+#ifndef _SMUX_CORO_HPP_INCLUDED_
+#define _SMUX_CORO_HPP_INCLUDED_
+
+#include "smux.hpp"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <bitset>
+#include <cerrno>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+/**
+ * \file smux_coro.hpp
+ *
+ * Optional C++20 coroutine interface on top of smux.hpp (Linux only).
+ *
+ * smux::coro::async_connection drives a smux::connection on non-blocking file descriptors.
+ * Its recv() and send() return awaitables, so a coroutine can wait for the data of a
+ * channel or for the capacity to send without blocking the thread. The coroutines are run
+ * by smux::coro::executor, a minimal single-threaded epoll loop.
+ */
+
+namespace smux
+{
+namespace coro
+{
+    class executor;
+
+    /**
+     * \brief                   fire-and-forget coroutine
+     *
+     * A coroutine returning task does not start until it is passed to executor::spawn().
+     * Its frame is destroyed when it finishes, or by the executor if it is still suspended
+     * when the executor is destroyed. An exception leaving the coroutine is rethrown by
+     * executor::run().
+     */
+    class task
+    {
+        public:
+            struct promise_type
+            {
+                executor* exec = nullptr;
+
+                ~promise_type();
+
+                task get_return_object()
+                {
+                    return task(std::coroutine_handle<promise_type>::from_promise(*this));
+                }
+                std::suspend_always initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+                void return_void() {}
+                void unhandled_exception();
+            };
+
+            task(task&& other) noexcept
+                : _h(other._h)
+            {
+                other._h = nullptr;
+            }
+
+            task(task const&) = delete;
+            task& operator=(task const&) = delete;
+            task& operator=(task&&) = delete;
+
+            /**
+             * \brief                   dtor, destroys a task never spawned
+             */
+            ~task()
+            {
+                if(_h)
+                    _h.destroy();
+            }
+
+        private:
+            friend class executor;
+
+            explicit task(std::coroutine_handle<promise_type> h)
+                : _h(h)
+            {}
+
+            std::coroutine_handle<promise_type> _h;
+    };
+
+    /**
+     * \brief                   minimal single-threaded epoll executor
+     *
+     * Runs spawned tasks and resumes them when the file descriptors they wait for become
+     * ready. Not thread-safe.
+     *
+     * The executor owns the spawned tasks: tasks still suspended when it is destroyed are
+     * destroyed with it, which runs the destructors of their locals. Objects the tasks wait
+     * on (e.g. async_connection) must be destroyed before the executor.
+     */
+    class executor
+    {
+        public:
+            /**
+             * \brief                   interface of objects waiting for file descriptors
+             */
+            class handler
+            {
+                public:
+                    /**
+                     * \brief                   called when a watched fd is ready
+                     * \param fd                file descriptor
+                     * \param events            epoll events
+                     */
+                    virtual void on_event(int fd, uint32_t events) = 0;
+
+                protected:
+                    ~handler() = default;
+            };
+
+            /**
+             * \brief                   ctor
+             * \throw std::system_error
+             */
+            executor()
+                : _epfd(::epoll_create1(EPOLL_CLOEXEC))
+            {
+                if(_epfd < 0)
+                    throw std::system_error(errno, std::generic_category(), "epoll_create1");
+            }
+
+            // sorry, no copy
+            executor(executor const&) = delete;
+            executor& operator=(executor const&) = delete;
+
+            /**
+             * \brief                   dtor
+             */
+            ~executor()
+            {
+                _ready.clear();
+                // destroying a frame removes it from _tasks
+                while(!_tasks.empty())
+                    std::coroutine_handle<>::from_address(*_tasks.begin()).destroy();
+                ::close(_epfd);
+            }
+
+            /**
+             * \brief                   start a task on the next iteration of run()
+             */
+            void spawn(task t)
+            {
+                auto h = t._h;
+                t._h = nullptr;
+                h.promise().exec = this;
+                _tasks.insert(h.address());
+                _ready.push_back(h);
+            }
+
+            /**
+             * \brief                   resume a coroutine on the next iteration of run()
+             */
+            void post(std::coroutine_handle<> h)
+            {
+                _ready.push_back(h);
+            }
+
+            /**
+             * \brief                   set the events to watch on a file descriptor
+             * \param fd                file descriptor
+             * \param events            epoll events (0 = stop watching)
+             * \param h                 handler to call
+             * \throw std::system_error
+             */
+            void watch(int fd, uint32_t events, handler* h)
+            {
+                auto it = _handlers.find(fd);
+                if(!events)
+                {
+                    if(it != _handlers.end())
+                    {
+                        ::epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, nullptr);
+                        _handlers.erase(it);
+                    }
+                    return;
+                }
+
+                epoll_event ev = {};
+                ev.events = events;
+                ev.data.fd = fd;
+                int op = it == _handlers.end() ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+                if(::epoll_ctl(_epfd, op, fd, &ev) < 0)
+                    throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+                _handlers[fd] = h;
+            }
+
+            /**
+             * \brief                   run until no task is ready and no fd is watched
+             * \throw                   any exception leaving a task
+             */
+            void run()
+            {
+                epoll_event events[64];
+                for(;;)
+                {
+                    while(!_ready.empty())
+                    {
+                        auto h = _ready.front();
+                        _ready.pop_front();
+                        h.resume();
+                        if(_error)
+                            std::rethrow_exception(std::exchange(_error, nullptr));
+                    }
+                    if(_handlers.empty())
+                        break;
+
+                    int n = ::epoll_wait(_epfd, events, sizeof(events) / sizeof(events[0]), -1);
+                    if(n < 0)
+                    {
+                        if(errno == EINTR)
+                            continue;
+                        throw std::system_error(errno, std::generic_category(), "epoll_wait");
+                    }
+                    for(int i = 0; i < n; ++i)
+                    {
+                        auto it = _handlers.find(events[i].data.fd);
+                        if(it != _handlers.end())
+                            it->second->on_event(events[i].data.fd, events[i].events);
+                    }
+                }
+            }
+
+        private:
+            friend struct task::promise_type;
+
+            int _epfd;
+            std::deque<std::coroutine_handle<>> _ready;
+            std::unordered_map<int, handler*> _handlers;
+            std::unordered_set<void*> _tasks; // frames of spawned, unfinished tasks
+            std::exception_ptr _error;
+    };
+
+    inline task::promise_type::~promise_type()
+    {
+        if(exec)
+            exec->_tasks.erase(std::coroutine_handle<promise_type>::from_promise(*this).address());
+    }
+
+    inline void task::promise_type::unhandled_exception()
+    {
+        if(!exec)
+            std::terminate();
+        exec->_error = std::current_exception();
+    }
+
+    /**
+     * \brief                   coroutine interface to a smux::connection
+     *
+     * Sets the read and write functions of the connection to non-blocking reads and writes
+     * on the given file descriptors (O_NONBLOCK is set on them) and uses channel handles
+     * (basic_connection::open_channel()) for all channels used by recv() or send().
+     *
+     * Any number of coroutines may wait on the same object. Waiting senders complete in order.
+     */
+    class async_connection : private executor::handler
+    {
+        public:
+            /**
+             * \brief                   ctor
+             * \param exec              executor to run on
+             * \param conn              connection to use (must outlive this object)
+             * \param read_fd           file descriptor to read from
+             * \param write_fd          file descriptor to write to (may equal read_fd)
+             */
+            async_connection(executor& exec, connection& conn, int read_fd, int write_fd)
+                : _exec(exec)
+                , _conn(conn)
+                , _read_fd(read_fd)
+                , _write_fd(write_fd)
+            {
+                ::fcntl(read_fd, F_SETFL, ::fcntl(read_fd, F_GETFL) | O_NONBLOCK);
+                ::fcntl(write_fd, F_SETFL, ::fcntl(write_fd, F_GETFL) | O_NONBLOCK);
+
+                _conn.set_read_fn([this](void* buf, size_t count) {
+                    ssize_t ret = ::read(_read_fd, buf, count);
+                    if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        return static_cast<ssize_t>(0);
+                    if(ret <= 0)
+                        _eof = true;
+                    return ret;
+                });
+                _conn.set_write_fn([this](const void* buf, size_t count) {
+                    ssize_t ret = ::write(_write_fd, buf, count);
+                    if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        return static_cast<ssize_t>(0);
+                    if(ret < 0)
+                        _write_error = true;
+                    return ret;
+                });
+            }
+
+            // sorry, no copy (the connection refers to this object)
+            async_connection(async_connection const&) = delete;
+            async_connection& operator=(async_connection const&) = delete;
+
+            /**
+             * \brief                   dtor
+             */
+            ~async_connection()
+            {
+                _exec.watch(_read_fd, 0, nullptr);
+                _exec.watch(_write_fd, 0, nullptr);
+            }
+
+            /// awaitable returned by recv()
+            class recv_awaiter
+            {
+                public:
+                    bool await_ready()
+                    {
+                        return _try();
+                    }
+                    void await_suspend(std::coroutine_handle<> h)
+                    {
+                        _h = h;
+                        _self._readers.push_back(this);
+                        _self._update();
+                    }
+                    size_t await_resume() const
+                    {
+                        return _result;
+                    }
+
+                private:
+                    friend class async_connection;
+
+                    recv_awaiter(async_connection& self, smux_channel ch, void* buf, size_t count)
+                        : _self(self), _ch(self._channel(ch)), _buf(buf), _count(count)
+                    {}
+
+                    // true when finished
+                    bool _try()
+                    {
+                        _result = _ch.try_recv(_buf, _count);
+                        return _result > 0 || _self._eof;
+                    }
+
+                    // like _try(), but read from the fd until it would block
+                    bool _read()
+                    {
+                        _result = _ch.recv(_buf, _count);
+                        return _result > 0 || _self._eof;
+                    }
+
+                    async_connection& _self;
+                    channel _ch;
+                    void* _buf;
+                    size_t _count;
+                    size_t _result = 0;
+                    std::coroutine_handle<> _h;
+            };
+
+            /// awaitable returned by send()
+            class send_awaiter
+            {
+                public:
+                    bool await_ready()
+                    {
+                        return _self._writers.empty() && _try();
+                    }
+                    void await_suspend(std::coroutine_handle<> h)
+                    {
+                        _h = h;
+                        _self._writers.push_back(this);
+                        _self._update();
+                    }
+                    size_t await_resume() const
+                    {
+                        return _done;
+                    }
+
+                private:
+                    friend class async_connection;
+
+                    send_awaiter(async_connection& self, smux_channel ch, const void* buf, size_t count)
+                        : _self(self), _ch(self._channel(ch)), _buf(static_cast<const char*>(buf))
+                        , _count(count)
+                    {}
+
+                    // true when finished
+                    bool _try()
+                    {
+                        for(;;)
+                        {
+                            size_t n = _ch.try_send(_buf + _done, _count - _done);
+                            _done += n;
+                            bool flushed = _ch.flush();
+                            if(_self._write_error || (_done == _count && flushed))
+                                return true;
+                            if(!n && !flushed)
+                                return false;
+                        }
+                    }
+
+                    async_connection& _self;
+                    channel _ch;
+                    const char* _buf;
+                    size_t _count;
+                    size_t _done = 0;
+                    std::coroutine_handle<> _h;
+            };
+
+            /**
+             * \brief                   receive data of a channel
+             * \param ch                channel
+             * \param buf               buffer
+             * \param count             capacity of buf
+             * \return                  awaitable yielding the number of received bytes (0 at end
+             *                          of file or on error)
+             */
+            recv_awaiter recv(smux_channel ch, void* buf, size_t count)
+            {
+                return recv_awaiter(*this, ch, buf, count);
+            }
+
+            /**
+             * \brief                   send data on a channel
+             * \param ch                channel
+             * \param buf               data
+             * \param count             number of bytes
+             * \return                  awaitable yielding the number of sent bytes (less than
+             *                          count only on error)
+             *
+             * The awaitable completes once the data has been written to the file descriptor.
+             */
+            send_awaiter send(smux_channel ch, const void* buf, size_t count)
+            {
+                return send_awaiter(*this, ch, buf, count);
+            }
+
+            /// true if the end of the input has been reached
+            bool eof() const
+            {
+                return _eof;
+            }
+
+        private:
+            channel _channel(smux_channel ch)
+            {
+                if(_opened[ch])
+                    return channel(_conn, ch);
+                _opened[ch] = true;
+                return _conn.open_channel(ch);
+            }
+
+            void on_event(int fd, uint32_t events) override
+            {
+                if(fd == _read_fd && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                    _on_readable();
+                if(fd == _write_fd && (events & (EPOLLOUT | EPOLLERR)))
+                    _on_writable();
+                _update();
+            }
+
+            void _on_readable()
+            {
+                // reading for one reader may queue data for another one already checked, so
+                // repeat until nobody completes (the fd may be empty by then)
+                bool progress = true;
+                while(progress)
+                {
+                    progress = false;
+                    for(auto it = _readers.begin(); it != _readers.end();)
+                    {
+                        if((*it)->_read())
+                        {
+                            _exec.post((*it)->_h);
+                            it = _readers.erase(it);
+                            progress = true;
+                        }
+                        else
+                            ++it;
+                    }
+                }
+            }
+
+            void _on_writable()
+            {
+                while(!_writers.empty() && _writers.front()->_try())
+                {
+                    _exec.post(_writers.front()->_h);
+                    _writers.pop_front();
+                }
+            }
+
+            // watch the fds needed by the waiting coroutines
+            void _update()
+            {
+                uint32_t rd = !_readers.empty() && !_eof ? EPOLLIN : 0;
+                uint32_t wr = !_writers.empty() ? EPOLLOUT : 0;
+                if(_read_fd == _write_fd)
+                    _exec.watch(_read_fd, rd | wr, this);
+                else
+                {
+                    _exec.watch(_read_fd, rd, this);
+                    _exec.watch(_write_fd, wr, this);
+                }
+            }
+
+            executor& _exec;
+            connection& _conn;
+            int _read_fd;
+            int _write_fd;
+            bool _eof = false;
+            bool _write_error = false;
+            std::bitset<smux_channel_max + 1> _opened;
+            std::vector<recv_awaiter*> _readers;
+            std::deque<send_awaiter*> _writers;
+    };
+
+} // namespace coro
+} // namespace smux
+
+#endif // coroutine support
+
+#endif // ifndef _SMUX_CORO_HPP_INCLUDED_
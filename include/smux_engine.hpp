@@ -0,0 +1,213 @@
+/// \file smux_engine.hpp
+#ifndef _SMUX_ENGINE_HPP_INCLUDED_
+#define _SMUX_ENGINE_HPP_INCLUDED_
+
+#include "smux.hpp"
+
+#include <cerrno>
+#include <functional>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+/**
+ * \file smux_engine.hpp
+ *
+ * Non-blocking reactor for embedding smux into an existing event loop (POSIX only).
+ *
+ * smux::engine never waits itself. The surrounding loop asks want_read() and want_write()
+ * which events to wait for and calls on_readable() or on_writable() when the multiplexed
+ * file descriptors are ready. Decoded data is delivered to per-channel callbacks.
+ */
+
+namespace smux
+{
+    /**
+     * \brief                   non-blocking smux reactor
+     *
+     * The file descriptors should be non-blocking; EAGAIN is treated as "no progress".
+     *
+     * Example (epoll):
+     * \code
+     * smux::engine e(fd, fd);
+     * e.on_data(1, [](const char* buf, size_t count) { ... });
+     * e.send(1, "hello", 5);
+     * // in the loop: watch fd for EPOLLIN if e.want_read(), EPOLLOUT if e.want_write()
+     * if(ev.events & EPOLLIN)  e.on_readable(fd);
+     * if(ev.events & EPOLLOUT) e.on_writable(fd);
+     * \endcode
+     */
+    class engine
+    {
+        public:
+            /// callback for decoded data of a channel
+            using data_fn = std::function<void (const char* buf, size_t count)>;
+
+            /**
+             * \brief                   ctor
+             * \param read_fd           file descriptor to read the multiplexed stream from
+             * \param write_fd          file descriptor to write the multiplexed stream to
+             * \param write_buf_size    writer buffer size (must be >= 16)
+             * \param read_buf_size     reader buffer size (must be >= 16)
+             */
+            engine(int read_fd, int write_fd,
+                    size_t write_buf_size = DEFAULT_BUF_SIZE, size_t read_buf_size = DEFAULT_BUF_SIZE)
+                : _conn(write_buf_size, read_buf_size)
+                , _read_fd(read_fd)
+                , _write_fd(write_fd)
+                , _scratch(read_buf_size)
+            {
+                _conn.set_read_fn([this](void* buf, size_t count) {
+                    ssize_t ret = ::read(_read_fd, buf, count);
+                    if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        return static_cast<ssize_t>(0);
+                    if(ret < 0)
+                        _errno = errno;
+                    else if(ret == 0)
+                        _eof = true;
+                    return ret;
+                });
+                _conn.set_write_fn([this](const void* buf, size_t count) {
+                    ssize_t ret = ::write(_write_fd, buf, count);
+                    if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        return static_cast<ssize_t>(0);
+                    if(ret < 0)
+                        _errno = errno;
+                    return ret;
+                });
+
+                // only channels with a callback are received
+                for(unsigned ch = smux_channel_min; ch <= smux_channel_max; ++ch)
+                    _conn.subscribe(static_cast<smux_channel>(ch), false);
+            }
+
+            // sorry, no copy (the connection refers to this object)
+            engine(engine const&) = delete;
+            engine& operator=(engine const&) = delete;
+
+            /**
+             * \brief                   set the callback for a channel
+             * \param ch                channel
+             * \param fn                callback (empty to ignore the channel)
+             *
+             * The callback is called from on_readable() with each decoded piece of data.
+             * Frames may be delivered in several pieces.
+             */
+            void on_data(smux_channel ch, data_fn fn)
+            {
+                _conn.subscribe(ch, static_cast<bool>(fn));
+                _callbacks[ch] = std::move(fn);
+            }
+
+            /**
+             * \brief                   queue data for sending
+             * \param ch                channel
+             * \param buf               data
+             * \param count             number of bytes
+             * \return                  number of bytes queued
+             *
+             * Never writes; the data is written by on_writable().
+             */
+            size_t send(smux_channel ch, const void* buf, size_t count)
+            {
+                size_t ret = _conn.send(ch, buf, count);
+                if(ret)
+                    _pending = true;
+                return ret;
+            }
+
+            /// true if the engine waits for data to read
+            bool want_read() const
+            {
+                return !_eof;
+            }
+
+            /// true if the engine has data to write
+            bool want_write() const
+            {
+                return _pending;
+            }
+
+            /**
+             * \brief                   read and dispatch available data
+             * \param fd                the readable file descriptor (ignored unless it is the read fd)
+             * \throw std::system_error if reading fails
+             */
+            void on_readable(int fd)
+            {
+                if(fd != _read_fd)
+                    return;
+
+                auto* rc = _conn.receiver_type::smux();
+                for(;;)
+                {
+                    unsigned rb_head = rc->_internal.rb_head;
+                    ssize_t ret = _conn.read();
+                    _check("read");
+                    bool progress = ret >= 0 && rb_head != rc->_internal.rb_head;
+
+                    size_t count;
+                    smux_channel ch;
+                    while((count = _conn.recv(&ch, _scratch.data(), _scratch.size())) > 0)
+                    {
+                        if(_callbacks[ch])
+                            _callbacks[ch](_scratch.data(), count);
+                    }
+                    if(!progress || _eof)
+                        break;
+                }
+            }
+
+            /**
+             * \brief                   write queued data as far as possible
+             * \param fd                the writable file descriptor (ignored unless it is the write fd)
+             * \throw std::system_error if writing fails
+             */
+            void on_writable(int fd)
+            {
+                if(fd != _write_fd)
+                    return;
+
+                ssize_t ret = _conn.write();
+                _check("write");
+                _pending = ret > 0;
+            }
+
+            /// true if the end of the input has been reached
+            bool eof() const
+            {
+                return _eof;
+            }
+
+            /// the underlying connection, e.g. to enable the elastic buffer
+            connection& conn()
+            {
+                return _conn;
+            }
+
+        private:
+            // throw a failure recorded by the read or write function
+            void _check(const char* what)
+            {
+                if(_errno)
+                {
+                    int err = _errno;
+                    _errno = 0;
+                    throw std::system_error(err, std::generic_category(), what);
+                }
+            }
+
+            connection _conn;
+            int _read_fd;
+            int _write_fd;
+            int _errno = 0;
+            bool _eof = false;
+            bool _pending = false;
+            std::vector<char> _scratch; // decode buffer
+            data_fn _callbacks[smux_channel_max + 1];
+    };
+
+} // namespace smux
+
+#endif // ifndef _SMUX_ENGINE_HPP_INCLUDED_
@@ -21,30 +21,253 @@ enum
   PROTO_CHANNEL_BYTES = 1,
   PROTO_SIZE_BYTES    = 2,
   PROTO_MAX_SIZE      = (1 << PROTO_SIZE_BYTES * 8) - 1,
+  PROTO_HEADER_BYTES  = 1 + PROTO_CHANNEL_BYTES + PROTO_SIZE_BYTES,
+  // frame descriptor in lazy encoding mode (channel and size field)
+  LAZY_DESC_BYTES     = PROTO_CHANNEL_BYTES + PROTO_SIZE_BYTES,
 };
 
+// segment of the elastic send buffer
+struct segment
+{
+    struct segment *next;
+    size_t head; // next character to write
+    size_t tail; // next character to read
+    char data[];
+};
+
+// check if a channel is subscribed
+static inline
+int SUBSCRIBED(struct smux_config_recv const *config, smux_channel ch)
+{
+  return (config->subscribed[ch >> 3] >> (ch & 7)) & 1;
+}
+
+// count escape chars (memchr is vectorized by the C library)
+static size_t count_esc(const char *buf, size_t count, char esc)
+{
+    const char *end = buf + count;
+    size_t n = 0;
+
+    for(; (buf = (const char*)memchr(buf, esc, end - buf)); buf++)
+        n++;
+    return n;
+}
+
+// usable bytes in a segment
+static inline
+size_t SEGCAP(struct smux_config_send const *config)
+{
+  return config->elastic.segment_size - sizeof(struct segment);
+}
+
 void smux_init(struct smux_config_send *cs, struct smux_config_recv *cr)
 {
     if(cr)
     {
         memset(cr, 0, sizeof(*cr));
         cr->proto.esc = '\x01';
+        memset(cr->subscribed, 0xFF, sizeof(cr->subscribed));
     }
     if(cs)
     {
         memset(cs, 0, sizeof(*cs));
         cs->proto.esc = '\x01';
+        cs->elastic.segment_size = 256;
     }
 }
 
 void smux_free(struct smux_config_send *cs, struct smux_config_recv *cr)
 {
+    struct segment *seg, *next;
+
     (void)cr;
-    (void)cs;
-    // no clean-up needed currently
+    if(cs)
+    {
+        // release all segments of the elastic buffer
+        for(seg = (struct segment*)cs->_internal.seg_first; seg; seg = next)
+        {
+            next = seg->next;
+            cs->elastic.release_fn(cs->elastic.alloc_fd, seg);
+        }
+        cs->_internal.seg_first = NULL;
+        cs->_internal.seg_last = NULL;
+        cs->_internal.seg_size = 0;
+        cs->_internal.seg_used = 0;
+    }
 }
 
-size_t smux_send(struct smux_config_send *config, smux_channel ch, const void *buf, size_t count)
+// get at least need contiguous bytes in the last segment, append a new one if necessary
+static char* seg_reserve(struct smux_config_send *config, size_t need, size_t *avail)
+{
+    struct segment *last = (struct segment*)config->_internal.seg_last;
+    size_t segment_size = config->elastic.segment_size;
+    size_t max_size = config->elastic.max_size;
+
+    if(last && SEGCAP(config) - last->head >= need)
+    {
+        *avail = SEGCAP(config) - last->head;
+        return last->data + last->head;
+    }
+
+    // segment too small or maximum size reached?
+    if(segment_size < sizeof(struct segment) + PROTO_HEADER_BYTES ||
+            (max_size && config->_internal.seg_size + segment_size > max_size))
+        return NULL;
+
+    struct segment *seg = (struct segment*)config->elastic.alloc_fn(config->elastic.alloc_fd, segment_size);
+    if(!seg)
+        return NULL;
+    seg->next = NULL;
+    seg->head = 0;
+    seg->tail = 0;
+
+    // append to the chain
+    if(last)
+        last->next = seg;
+    else
+        config->_internal.seg_first = seg;
+    config->_internal.seg_last = seg;
+    config->_internal.seg_size += segment_size;
+
+    *avail = SEGCAP(config);
+    return seg->data;
+}
+
+// commit bytes written to the area returned by seg_reserve()
+static inline
+void seg_commit(struct smux_config_send *config, size_t count)
+{
+    ((struct segment*)config->_internal.seg_last)->head += count;
+    config->_internal.seg_used += count;
+}
+
+// encode into the segments of the elastic buffer
+static size_t send_segments(struct smux_config_send *config, smux_channel ch, const char *input_buf, size_t count)
+{
+    char esc = config->proto.esc;
+    char *size_field = NULL; // size field position in a segment
+    size_t count_copied = 0;
+    size_t avail, used;
+    char *p;
+
+    // insert channel & size field, reserved together with the first (encoded) payload byte
+    // so that a failing reservation cannot leave an empty frame behind
+    if(ch != 0)
+    {
+        p = seg_reserve(config, PROTO_HEADER_BYTES + (input_buf[0] == esc ? 2 : 1), &avail);
+        if(!p)
+            return 0;
+        p[0] = esc;
+        p[1] = (char)ch;
+        size_field = p + 2;
+        seg_commit(config, PROTO_HEADER_BYTES);
+    }
+
+    // fill segment by segment
+    while(count_copied < count)
+    {
+        p = seg_reserve(config, 1, &avail);
+        if(!p)
+            break;
+
+        for(used = 0; count_copied < count && used < avail; count_copied++)
+        {
+            if(input_buf[count_copied] == esc)
+            {
+                // keep escape sequences within a segment
+                if(avail - used < 2)
+                    break;
+                p[used++] = esc;
+                p[used++] = 0;
+            } else
+                p[used++] = input_buf[count_copied];
+        }
+        seg_commit(config, used);
+
+        // escape sequence did not fit -> force a new segment
+        if(count_copied < count && used < avail && !seg_reserve(config, 2, &avail))
+            break;
+    }
+
+    // write size field (big endian)
+    if(ch != 0)
+    {
+        size_field[0] = (char)(count_copied >> 8);
+        size_field[1] = (char)(count_copied & 0xFF);
+    }
+
+    return count_copied;
+}
+
+// store a frame in the segments of the elastic buffer (lazy encoding)
+static size_t send_segments_lazy(struct smux_config_send *config, smux_channel ch, const char *input_buf, size_t count)
+{
+    char *size_field;
+    size_t count_copied = 0;
+    size_t avail;
+    char *p;
+
+    // frame descriptor, reserved together with the first payload byte (no empty frames)
+    p = seg_reserve(config, LAZY_DESC_BYTES + 1, &avail);
+    if(!p)
+        return 0;
+    p[0] = (char)ch;
+    size_field = p + 1;
+    seg_commit(config, LAZY_DESC_BYTES);
+
+    // raw payload
+    while(count_copied < count && (p = seg_reserve(config, 1, &avail)))
+    {
+        if(avail > count - count_copied)
+            avail = count - count_copied;
+        memcpy(p, input_buf + count_copied, avail);
+        seg_commit(config, avail);
+        count_copied += avail;
+    }
+
+    size_field[0] = (char)(count_copied >> 8);
+    size_field[1] = (char)(count_copied & 0xFF);
+
+    return count_copied;
+}
+
+// store a frame in the write buffer (lazy encoding)
+static size_t send_ring_lazy(struct smux_config_send *config, smux_channel ch, const char *input_buf, size_t count)
+{
+    char *write_buf = (char*)config->buffer.write_buf;
+    unsigned wb_head = config->_internal.wb_head;
+    unsigned wb_tail = config->_internal.wb_tail;
+    size_t write_buf_size = config->buffer.write_buf_size;
+    // leave one byte to separate full/empty
+    size_t write_buf_free = write_buf_size - RBUSED(wb_head, wb_tail, write_buf_size) - 1;
+    size_t part;
+
+    if(write_buf_free <= LAZY_DESC_BYTES)
+        return 0;
+    if(count > write_buf_free - LAZY_DESC_BYTES)
+        count = write_buf_free - LAZY_DESC_BYTES;
+
+    // frame descriptor
+    write_buf[wb_head] = (char)ch;
+    wb_head = ADJRBI(wb_head + 1, write_buf_size);
+    write_buf[wb_head] = (char)(count >> 8);
+    wb_head = ADJRBI(wb_head + 1, write_buf_size);
+    write_buf[wb_head] = (char)(count & 0xFF);
+    wb_head = ADJRBI(wb_head + 1, write_buf_size);
+
+    // raw payload (wraps around at most once)
+    part = write_buf_size - wb_head;
+    if(part > count)
+        part = count;
+    memcpy(write_buf + wb_head, input_buf, part);
+    memcpy(write_buf, input_buf + part, count - part);
+    config->_internal.wb_head = ADJRBI(wb_head + count, write_buf_size);
+
+    return count;
+}
+
+// encode into the write buffer
+static size_t send_ring(struct smux_config_send *config, smux_channel ch, const void *buf, size_t count)
 {
     char *write_buf = (char*)config->buffer.write_buf;
     unsigned wb_head = config->_internal.wb_head;
@@ -57,18 +280,11 @@ size_t smux_send(struct smux_config_send *config, smux_channel ch, const void *b
     char* input_buf = (char*)buf;
     size_t count_copied = 0; // copied chars from input_buf
 
-    // catch trivial case
-    if(count <= 0) return 0;
-
-    // limit size
-    if(count > PROTO_MAX_SIZE)
-        count = PROTO_MAX_SIZE;
-
     // insert channel & size field
     if(ch != 0)
     {
         // enough space for escape byte, the channel and size fields?
-        if(write_buf_used + 1 + PROTO_CHANNEL_BYTES + PROTO_SIZE_BYTES >= write_buf_size - 1)
+        if(write_buf_used + PROTO_HEADER_BYTES >= write_buf_size - 1)
             return 0;
 
         // esc char
@@ -116,6 +332,210 @@ size_t smux_send(struct smux_config_send *config, smux_channel ch, const void *b
     return count_copied;
 }
 
+size_t smux_send(struct smux_config_send *config, smux_channel ch, const void *buf, size_t count)
+{
+    size_t count_copied = 0;
+
+    // catch trivial case
+    if(count <= 0) return 0;
+
+    // limit size
+    if(count > PROTO_MAX_SIZE)
+        count = PROTO_MAX_SIZE;
+
+    if(config->buffer.lazy)
+    {
+        // store raw data, it is encoded on writing
+        if(!config->_internal.seg_last)
+            count_copied = send_ring_lazy(config, ch, (const char*)buf, count);
+        if(count_copied < count && config->elastic.alloc_fn)
+            count_copied += send_segments_lazy(config, ch, (const char*)buf + count_copied, count - count_copied);
+        return count_copied;
+    }
+
+    // the write buffer is only used as long as no segments are waiting (keep the order)
+    if(!config->_internal.seg_last)
+        count_copied = send_ring(config, ch, buf, count);
+
+    // put the rest into the elastic buffer
+    if(count_copied < count && config->elastic.alloc_fn)
+        count_copied += send_segments(config, ch, (const char*)buf + count_copied, count - count_copied);
+
+    return count_copied;
+}
+
+// output cursor over the write buffer or a chain of segments
+struct cursor
+{
+    char *p; // current position
+    size_t n; // space left in the current area
+    char *next; // next area of the write buffer (after wrap-around)
+    struct segment *seg; // current segment
+    size_t segcap; // usable bytes of a segment
+};
+
+// copy data to the cursor position, continue in the next area if necessary
+static void cursor_put(struct cursor *c, const char *data, size_t count)
+{
+    size_t part;
+
+    while(count > 0)
+    {
+        if(c->n == 0)
+        {
+            if(c->seg)
+            {
+                c->seg = c->seg->next;
+                c->p = c->seg->data;
+                c->n = c->segcap;
+            } else
+            {
+                c->p = c->next;
+                c->n = count;
+            }
+        }
+        part = count < c->n ? count : c->n;
+        memcpy(c->p, data, part);
+        if(c->seg)
+            c->seg->head += part;
+        c->p += part;
+        c->n -= part;
+        data += part;
+        count -= part;
+    }
+}
+
+// encode a complete frame in one pass
+static void encode_frame(struct cursor *c, struct smux_config_send const *config, smux_channel ch,
+        const char *input_buf, size_t count)
+{
+    char esc = config->proto.esc;
+    char header[PROTO_HEADER_BYTES] = { esc, (char)ch, (char)(count >> 8), (char)(count & 0xFF) };
+    static const char esc_seq_tail = 0;
+    const char *end = input_buf + count;
+    const char *e;
+
+    // lazy mode: descriptor and raw payload
+    if(config->buffer.lazy)
+    {
+        cursor_put(c, header + 1, LAZY_DESC_BYTES);
+        cursor_put(c, input_buf, count);
+        return;
+    }
+
+    if(ch != 0)
+        cursor_put(c, header, PROTO_HEADER_BYTES);
+
+    // copy runs between escape chars
+    while(input_buf < end)
+    {
+        e = (const char*)memchr(input_buf, esc, end - input_buf);
+        if(!e)
+            e = end;
+        cursor_put(c, input_buf, e - input_buf);
+        if(e == end)
+            break;
+        cursor_put(c, e, 1);
+        cursor_put(c, &esc_seq_tail, 1);
+        input_buf = e + 1;
+    }
+}
+
+size_t smux_send_atomic(struct smux_config_send *config, smux_channel ch, const void *buf, size_t count)
+{
+    char *write_buf = (char*)config->buffer.write_buf;
+    unsigned wb_head = config->_internal.wb_head;
+    unsigned wb_tail = config->_internal.wb_tail;
+    size_t write_buf_size = config->buffer.write_buf_size;
+    size_t segment_size = config->elastic.segment_size;
+    size_t max_size = config->elastic.max_size;
+    struct segment *last = (struct segment*)config->_internal.seg_last;
+    struct segment *first_new = NULL, *last_new = NULL, *seg;
+    struct cursor c;
+    size_t encoded, avail, missing, n;
+
+    if(count <= 0 || count > PROTO_MAX_SIZE)
+        return 0;
+
+    // exact size of the encoded frame
+    if(config->buffer.lazy)
+        encoded = LAZY_DESC_BYTES + count;
+    else
+        encoded = (ch != 0 ? PROTO_HEADER_BYTES : 0) + count + count_esc((const char*)buf, count, config->proto.esc);
+
+    // write buffer (leave one byte to separate full/empty)
+    if(!last && write_buf_size - RBUSED(wb_head, wb_tail, write_buf_size) - 1 >= encoded)
+    {
+        c.p = write_buf + wb_head;
+        c.n = write_buf_size - wb_head;
+        c.next = write_buf;
+        c.seg = NULL;
+        encode_frame(&c, config, ch, (const char*)buf, count);
+        config->_internal.wb_head = ADJRBI(wb_head + encoded, write_buf_size);
+        return count;
+    }
+
+    // elastic buffer
+    if(!config->elastic.alloc_fn || segment_size < sizeof(struct segment) + PROTO_HEADER_BYTES)
+        return 0;
+    avail = last ? SEGCAP(config) - last->head : 0;
+    missing = encoded > avail ? (encoded - avail + SEGCAP(config) - 1) / SEGCAP(config) : 0;
+    if(max_size && config->_internal.seg_size + missing * segment_size > max_size)
+        return 0;
+
+    // allocate all required segments beforehand
+    for(n = 0; n < missing; n++)
+    {
+        seg = (struct segment*)config->elastic.alloc_fn(config->elastic.alloc_fd, segment_size);
+        if(!seg)
+        {
+            // undo
+            for(; first_new; first_new = seg)
+            {
+                seg = first_new->next;
+                config->elastic.release_fn(config->elastic.alloc_fd, first_new);
+            }
+            return 0;
+        }
+        seg->next = NULL;
+        seg->head = 0;
+        seg->tail = 0;
+        if(last_new)
+            last_new->next = seg;
+        else
+            first_new = seg;
+        last_new = seg;
+    }
+
+    // append them to the chain
+    if(first_new)
+    {
+        if(last)
+            last->next = first_new;
+        else
+            config->_internal.seg_first = first_new;
+        config->_internal.seg_last = last_new;
+        config->_internal.seg_size += missing * segment_size;
+    }
+
+    c.seg = avail > 0 ? last : first_new;
+    c.p = c.seg->data + c.seg->head;
+    c.n = avail > 0 ? avail : SEGCAP(config);
+    c.segcap = SEGCAP(config);
+    encode_frame(&c, config, ch, (const char*)buf, count);
+    config->_internal.seg_used += encoded;
+
+    return count;
+}
+
+void smux_subscribe(struct smux_config_recv *config, smux_channel ch, int subscribe)
+{
+    if(subscribe)
+        config->subscribed[ch >> 3] |= 1 << (ch & 7);
+    else
+        config->subscribed[ch >> 3] &= ~(1 << (ch & 7));
+}
+
 size_t smux_recv(struct smux_config_recv *config, smux_channel *ch, void *buf, size_t count)
 {
     char *read_buf = (char*)config->buffer.read_buf;
@@ -126,9 +546,12 @@ size_t smux_recv(struct smux_config_recv *config, smux_channel *ch, void *buf, s
     smux_channel recv_ch = config->_internal.recv_ch; // current channel
     size_t recv_chars = config->_internal.recv_chars; // remaining payload chars
     char esc = config->proto.esc;
+    int skip = !SUBSCRIBED(config, recv_ch); // skip payload of recv_ch
 
     char* output_buf = (char*)buf;
     size_t count_copied = 0;
+    size_t run;
+    const char *e;
 
     // read buffer byte wise
     *ch = recv_ch;
@@ -137,6 +560,28 @@ size_t smux_recv(struct smux_config_recv *config, smux_channel *ch, void *buf, s
         rb_head != rb_tail // receive buffer not empty
     )
     {
+        if(skip && read_buf[rb_tail] != esc)
+        {
+            // skip payload up to the next escape char or the end of the frame
+            run = (rb_tail < rb_head ? rb_head : read_buf_size) - rb_tail;
+            if(recv_ch != 0 && run > recv_chars)
+                run = recv_chars;
+            e = (const char*)memchr(read_buf + rb_tail, esc, run);
+            if(e)
+                run = e - (read_buf + rb_tail);
+            rb_tail = ADJRBI(rb_tail + run, read_buf_size);
+            recv_chars -= run;
+
+            // end of skipped frame -> continue on default channel
+            if(recv_ch != 0 && recv_chars == 0)
+            {
+                recv_ch = 0;
+                skip = !SUBSCRIBED(config, 0);
+                *ch = 0;
+            }
+            continue;
+        }
+
         rb_tail_old = rb_tail;
         if(read_buf[rb_tail] == esc)
         {
@@ -151,9 +596,18 @@ size_t smux_recv(struct smux_config_recv *config, smux_channel *ch, void *buf, s
 
             if(read_buf[rb_tail] == 0) // just escape of esc char
             {
-                output_buf[count_copied++] = esc;
+                if(!skip)
+                    output_buf[count_copied++] = esc;
                 recv_chars -= 1;
                 rb_tail = ADJRBI(rb_tail + 1, read_buf_size);
+
+                // end of skipped frame -> continue on default channel
+                if(skip && recv_ch != 0 && recv_chars == 0)
+                {
+                    recv_ch = 0;
+                    skip = !SUBSCRIBED(config, 0);
+                    *ch = 0;
+                }
             } else // channel information
             {
                 // enough to decode channel and size?
@@ -169,6 +623,7 @@ size_t smux_recv(struct smux_config_recv *config, smux_channel *ch, void *buf, s
                 rb_tail = ADJRBI(rb_tail + 1, read_buf_size);
                 recv_chars |= read_buf[rb_tail] & 0xFF;
                 rb_tail = ADJRBI(rb_tail + 1, read_buf_size);
+                skip = !SUBSCRIBED(config, recv_ch);
 
                 if(count_copied > 0)
                 {
@@ -206,47 +661,344 @@ size_t smux_recv(struct smux_config_recv *config, smux_channel *ch, void *buf, s
     return count_copied;
 }
 
-ssize_t smux_write(struct smux_config_send *config)
+void *smux_send_reserve(struct smux_config_send *config, smux_channel ch, size_t max_len)
 {
     char *write_buf = (char*)config->buffer.write_buf;
     unsigned wb_head = config->_internal.wb_head;
     unsigned wb_tail = config->_internal.wb_tail;
     size_t write_buf_size = config->buffer.write_buf_size;
-    smux_write_fn write_fn = config->buffer.write_fn;
-    void *fd = config->buffer.write_fd;
-
-    ssize_t ret, count;
+    int lazy = config->buffer.lazy;
+    size_t header = lazy ? LAZY_DESC_BYTES : ch != 0 ? PROTO_HEADER_BYTES : 0;
     unsigned end;
 
-    if(write_fn)
+    if(max_len <= 0 || max_len > PROTO_MAX_SIZE || config->_internal.seg_last)
+        return NULL;
+
+    // optimization: start at the beginning if the buffer is empty
+    if(wb_head == wb_tail)
     {
-        while(wb_head != wb_tail)
+        wb_head = 0;
+        wb_tail = 0;
+        config->_internal.wb_head = 0;
+        config->_internal.wb_tail = 0;
+    }
+
+    // end of contiguous free space (leave one byte to separate full/empty)
+    if(wb_head < wb_tail)
+        end = wb_tail - 1;
+    else
+        end = wb_tail == 0 ? write_buf_size - 1 : write_buf_size;
+
+    if(wb_head + header + max_len > end)
+        return NULL;
+
+    // write escape char (not in lazy mode) and channel, the size field follows on commit
+    if(lazy)
+        write_buf[wb_head] = (char)ch;
+    else if(ch != 0)
+    {
+        write_buf[wb_head] = config->proto.esc;
+        write_buf[wb_head + 1] = (char)ch;
+    }
+
+    config->_internal.rsv_start = wb_head + header;
+    config->_internal.rsv_end = end;
+    config->_internal.rsv_len = max_len;
+    config->_internal.rsv_ch = ch;
+    return write_buf + wb_head + header;
+}
+
+size_t smux_send_commit(struct smux_config_send *config, size_t actual_len)
+{
+    char *write_buf = (char*)config->buffer.write_buf;
+    size_t write_buf_size = config->buffer.write_buf_size;
+    unsigned start = config->_internal.rsv_start;
+    char esc = config->proto.esc;
+    char *payload = write_buf + start;
+    char *src, *dst;
+    size_t escapes = 0;
+
+    if(actual_len > config->_internal.rsv_len)
+        actual_len = config->_internal.rsv_len;
+    config->_internal.rsv_len = 0; // release the reservation
+    if(actual_len <= 0)
+        return 0;
+
+    // count escape chars (not stored in lazy mode)
+    if(!config->buffer.lazy)
+        escapes = count_esc(payload, actual_len, esc);
+
+    if(escapes > 0)
+    {
+        // enough space to escape in place?
+        if(start + actual_len + escapes > config->_internal.rsv_end)
+            return 0;
+
+        // escape from back to front
+        src = payload + actual_len;
+        dst = src + escapes;
+        while(src != dst)
         {
-            // end of area to transmit
-            end = wb_tail < wb_head ? wb_head : write_buf_size;
+            if(*--src == esc)
+            {
+                *--dst = 0;
+                *--dst = esc;
+            } else
+                *--dst = *src;
+        }
+    }
 
-            count = end - wb_tail;
-            ret = write_fn(fd, (void*)(write_buf + wb_tail), count);
-            if(ret <= 0)
-                break;
+    // write size field (big endian)
+    if(config->buffer.lazy || config->_internal.rsv_ch != 0)
+    {
+        write_buf[start - 2] = (char)(actual_len >> 8);
+        write_buf[start - 1] = (char)(actual_len & 0xFF);
+    }
+
+    // publish the frame
+    config->_internal.wb_head = ADJRBI(start + actual_len + escapes, write_buf_size);
+
+    return actual_len;
+}
+
+// destination of written data: write function or external buffer
+struct sink
+{
+    smux_write_fn write_fn;
+    void *fd;
+    char *buf; // used if write_fn is NULL
+    size_t count; // space left in buf
+};
+
+// output data, return the number of accepted bytes or an error
+static ssize_t sink_put(struct sink *sink, const char *data, size_t count)
+{
+    ssize_t ret;
+    size_t done = 0;
 
-            wb_tail = ADJRBI(wb_tail + (ret>count?count:ret), write_buf_size);
+    if(!sink->write_fn)
+    {
+        if(count > sink->count)
+            count = sink->count;
+        memcpy(sink->buf, data, count);
+        sink->buf += count;
+        sink->count -= count;
+        return count;
+    }
+
+    // call the write function until it stops accepting data
+    while(done < count)
+    {
+        ret = sink->write_fn(sink->fd, (const void*)(data + done), count - done);
+        if(ret <= 0)
+            return done > 0 ? (ssize_t)done : ret;
+        done += (size_t)ret > count - done ? count - done : (size_t)ret;
+    }
+    return done;
+}
+
+// output pending header/escape bytes in lazy mode
+static ssize_t drain_pending(struct smux_config_send *config, struct sink *sink)
+{
+    unsigned pos = config->_internal.lz_out_pos;
+    unsigned len = config->_internal.lz_out_len;
+    ssize_t ret = 0;
+
+    if(pos < len)
+    {
+        ret = sink_put(sink, config->_internal.lz_out + pos, len - pos);
+        if(ret > 0)
+            config->_internal.lz_out_pos = pos += ret;
+    }
+    return pos < len ? (ret < 0 ? ret : 0) : 1;
+}
+
+/*
+ * write out a contiguous part of the buffer, return the number of consumed bytes or an
+ * error, set *blocked if the sink did not accept everything
+ *
+ * In lazy mode, frame headers are generated from the descriptors and escape chars are
+ * escaped on the fly. Runs without escape chars are passed directly to the sink.
+ */
+static ssize_t drain(struct smux_config_send *config, struct sink *sink, const char *data, size_t count, int *blocked)
+{
+    char esc = config->proto.esc;
+    size_t consumed = 0, run;
+    const char *e;
+    ssize_t ret;
+
+    if(!config->buffer.lazy)
+    {
+        ret = sink_put(sink, data, count);
+        *blocked = ret < (ssize_t)count;
+        return ret;
+    }
+
+    while(1)
+    {
+        // generated bytes go first
+        ret = drain_pending(config, sink);
+        if(ret <= 0)
+        {
+            *blocked = 1;
+            return ret < 0 ? ret : (ssize_t)consumed;
         }
+        if(consumed == count)
+            break;
 
-        // optimization: if buffer is empty, reset head and tail to beginning
-        if(wb_tail == wb_head)
+        if(config->_internal.lz_remain == 0)
         {
-            config->_internal.wb_head = 0;
-            wb_tail = 0;
+            // collect frame descriptor
+            config->_internal.lz_desc[config->_internal.lz_desc_len++] = data[consumed++];
+            if(config->_internal.lz_desc_len < LAZY_DESC_BYTES)
+                continue;
+            config->_internal.lz_desc_len = 0;
+            config->_internal.lz_remain = ((config->_internal.lz_desc[1] << 8) & 0xFF00) |
+                (config->_internal.lz_desc[2] & 0xFF);
+
+            // header for channels other than 0
+            if(config->_internal.lz_desc[0] != 0 && config->_internal.lz_remain > 0)
+            {
+                config->_internal.lz_out[0] = esc;
+                memcpy(config->_internal.lz_out + 1, config->_internal.lz_desc, LAZY_DESC_BYTES);
+                config->_internal.lz_out_pos = 0;
+                config->_internal.lz_out_len = PROTO_HEADER_BYTES;
+            }
+            continue;
         }
 
-        // write new tail index back
-        config->_internal.wb_tail = wb_tail;
+        // payload up to the next escape char
+        run = count - consumed;
+        if(run > config->_internal.lz_remain)
+            run = config->_internal.lz_remain;
+        e = (const char*)memchr(data + consumed, esc, run);
+        if(e)
+            run = e - (data + consumed);
+        if(run > 0)
+        {
+            ret = sink_put(sink, data + consumed, run);
+            if(ret < 0)
+                return ret;
+            consumed += ret;
+            config->_internal.lz_remain -= ret;
+            if((size_t)ret < run)
+            {
+                *blocked = 1;
+                return consumed;
+            }
+        }
+        if(e)
+        {
+            // escape the escape char
+            consumed++;
+            config->_internal.lz_remain -= 1;
+            config->_internal.lz_out[0] = esc;
+            config->_internal.lz_out[1] = 0;
+            config->_internal.lz_out_pos = 0;
+            config->_internal.lz_out_len = 2;
+        }
+    }
+
+    *blocked = 0;
+    return consumed;
+}
+
+// write out the write buffer followed by the segments of the elastic buffer
+static ssize_t write_out(struct smux_config_send *config, struct sink *sink)
+{
+    char *write_buf = (char*)config->buffer.write_buf;
+    unsigned wb_head = config->_internal.wb_head;
+    unsigned wb_tail = config->_internal.wb_tail;
+    size_t write_buf_size = config->buffer.write_buf_size;
+    struct segment *seg;
+
+    ssize_t ret = 0;
+    int blocked = 0;
+    unsigned end;
+
+    while(wb_head != wb_tail)
+    {
+        // end of area to transmit
+        end = wb_tail < wb_head ? wb_head : write_buf_size;
+
+        ret = drain(config, sink, write_buf + wb_tail, end - wb_tail, &blocked);
+        if(ret < 0)
+            break;
+
+        wb_tail = ADJRBI(wb_tail + ret, write_buf_size);
+        if(blocked)
+            break;
+    }
+
+    // optimization: if buffer is empty, reset head and tail to beginning (not while a
+    // reservation is open, it is committed relative to the current head)
+    if(wb_tail == wb_head && config->_internal.rsv_len == 0)
+    {
+        wb_tail = 0;
+        config->_internal.wb_head = 0;
+    }
+
+    // write new tail index back
+    config->_internal.wb_tail = wb_tail;
+
+    if(ret < 0 || blocked || wb_tail != 0)
+        return ret;
+
+    // continue with the elastic buffer
+    while((seg = (struct segment*)config->_internal.seg_first))
+    {
+        ret = drain(config, sink, seg->data + seg->tail, seg->head - seg->tail, &blocked);
+        if(ret < 0)
+            break;
+        seg->tail += ret;
+        config->_internal.seg_used -= ret;
+        if(seg->tail != seg->head)
+            break;
 
+        // segment empty -> release it
+        config->_internal.seg_first = seg->next;
+        if(!seg->next)
+            config->_internal.seg_last = NULL;
+        config->_internal.seg_size -= config->elastic.segment_size;
+        config->elastic.release_fn(config->elastic.alloc_fd, seg);
+
+        if(blocked)
+            break;
+    }
+
+    // flush pending bytes of lazy encoding if everything else is gone
+    if(ret >= 0 && !config->_internal.seg_first)
+        ret = drain_pending(config, sink);
+
+    return ret;
+}
+
+size_t smux_write_pending(struct smux_config_send const *config)
+{
+    return RBUSED(config->_internal.wb_head, config->_internal.wb_tail, config->buffer.write_buf_size) +
+        config->_internal.seg_used + config->_internal.lz_out_len - config->_internal.lz_out_pos;
+}
+
+ssize_t smux_write(struct smux_config_send *config)
+{
+    struct sink sink = { config->buffer.write_fn, config->buffer.write_fd, NULL, 0 };
+    ssize_t ret;
+
+    if(sink.write_fn)
+    {
+        ret = write_out(config, &sink);
         if(ret < 0) // error?
             return ret;
     }
-    return RBUSED(wb_head, wb_tail, write_buf_size);
+    return smux_write_pending(config);
+}
+
+size_t smux_write_buf(struct smux_config_send *config, void *buf, size_t count)
+{
+    struct sink sink = { NULL, NULL, (char*)buf, count };
+
+    write_out(config, &sink);
+    return count - sink.count;
 }
 
 ssize_t smux_read(struct smux_config_recv *config)
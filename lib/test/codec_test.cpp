@@ -0,0 +1,110 @@
+// codec_test.cpp
+#include "lib_test.h"
+
+#include <string>
+#include <vector>
+
+#include <smux.hpp>
+
+namespace
+{
+    struct frame
+    {
+        smux_channel ch;
+        std::string data;
+    };
+
+    const std::vector<frame> frames = {
+        { 0, "ABC\x01""DEF" },
+        { 0x42, "123\x01" },
+        { 0, "GH" },
+        { 255, std::string(100, '\x01') },
+        { 7, "0123456789ABCDEFGHIJ" },
+    };
+}
+
+BOOST_AUTO_TEST_SUITE(codec);
+
+BOOST_AUTO_TEST_CASE(encode_like_c)
+{
+    smux_config_send cs;
+    char c_buf[512];
+    smux_init(&cs, nullptr);
+    cs.buffer.write_buf = c_buf;
+    cs.buffer.write_buf_size = sizeof(c_buf);
+
+    smux::basic_codec<'\x01', 512> codec;
+
+    for(auto const& f : frames)
+    {
+        BOOST_TEST(smux_send(&cs, f.ch, f.data.data(), f.data.size()) == f.data.size());
+        BOOST_TEST(codec.send(f.ch, f.data.data(), f.data.size()) == f.data.size());
+    }
+
+    char c_out[512], codec_out[512];
+    size_t c_len = smux_write_buf(&cs, c_out, sizeof(c_out));
+    std::string codec_str;
+    codec.write([&](const void* buf, size_t count) {
+        codec_str.append(static_cast<const char*>(buf), count);
+        return static_cast<ssize_t>(count);
+    });
+    BOOST_TEST(codec_str.size() == c_len);
+    BOOST_TEST(codec_str == std::string(c_out, c_len));
+
+    // write_buf yields the same
+    for(auto const& f : frames)
+        codec.send(f.ch, f.data.data(), f.data.size());
+    BOOST_TEST(codec.write_buf(codec_out, sizeof(codec_out)) == c_len);
+    BOOST_TEST(memcmp(codec_out, c_out, c_len) == 0);
+
+    smux_free(&cs, nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(decode_from_c)
+{
+    smux_config_send cs;
+    char c_buf[512];
+    smux_init(&cs, nullptr);
+    cs.buffer.write_buf = c_buf;
+    cs.buffer.write_buf_size = sizeof(c_buf);
+
+    for(auto const& f : frames)
+        smux_send(&cs, f.ch, f.data.data(), f.data.size());
+    char muxed[512];
+    size_t muxed_len = smux_write_buf(&cs, muxed, sizeof(muxed));
+
+    // feed in small pieces to test wrap-around and split escape sequences
+    smux::basic_codec<'\x01', 16> codec;
+    const char* p = muxed;
+    const char* e = muxed + muxed_len;
+    std::vector<frame> received;
+    char buf[7];
+    smux_channel ch;
+    while(p != e || codec.read([](void*, size_t) { return ssize_t(0); }) < 16)
+    {
+        codec.read([&](void* buf, size_t count) {
+            size_t n = std::min<size_t>(count, std::min<size_t>(e - p, 5));
+            memcpy(buf, p, n);
+            p += n;
+            return static_cast<ssize_t>(n);
+        });
+        size_t ret;
+        while((ret = codec.recv(&ch, buf, sizeof(buf))) > 0)
+        {
+            if(received.empty() || received.back().ch != ch)
+                received.push_back(frame{ch, ""});
+            received.back().data.append(buf, ret);
+        }
+    }
+
+    BOOST_TEST(received.size() == frames.size());
+    for(size_t i = 0; i < std::min(received.size(), frames.size()); ++i)
+    {
+        BOOST_TEST(received[i].ch == frames[i].ch);
+        BOOST_TEST(received[i].data == frames[i].data);
+    }
+
+    smux_free(&cs, nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,120 @@
+// coro_test.cpp
+#include "lib_test.h"
+
+#include <smux_coro.hpp>
+
+#ifdef _SMUX_CORO_HPP_INCLUDED_
+#if defined(__cpp_impl_coroutine)
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+namespace
+{
+    struct socket_pair
+    {
+        int fd[2];
+
+        socket_pair()
+        {
+            BOOST_REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == 0);
+        }
+        ~socket_pair()
+        {
+            ::close(fd[0]);
+            ::close(fd[1]);
+        }
+    };
+
+    smux::coro::task send_all(smux::coro::async_connection& conn, smux_channel ch, std::string data)
+    {
+        size_t ret = co_await conn.send(ch, data.data(), data.size());
+        BOOST_TEST(ret == data.size());
+    }
+
+    smux::coro::task recv_all(smux::coro::async_connection& conn, smux_channel ch, size_t count,
+            std::string& out)
+    {
+        char buf[512];
+        while(out.size() < count)
+        {
+            size_t ret = co_await conn.recv(ch, buf, sizeof(buf));
+            if(!ret)
+                break;
+            out.append(buf, ret);
+        }
+    }
+
+    struct set_on_destruction
+    {
+        bool& flag;
+        ~set_on_destruction()
+        {
+            flag = true;
+        }
+    };
+
+    smux::coro::task recv_forever(smux::coro::async_connection& conn, bool& destroyed)
+    {
+        set_on_destruction guard{destroyed};
+        char buf[16];
+        co_await conn.recv(1, buf, sizeof(buf));
+        BOOST_FAIL("no data has been sent");
+    }
+
+    smux::coro::task reset(std::optional<smux::coro::async_connection>& conn)
+    {
+        conn.reset();
+        co_return;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(coro);
+
+BOOST_AUTO_TEST_CASE(channels)
+{
+    socket_pair sp;
+    smux::connection a(64, 64), b(64, 64);
+    smux::coro::executor exec;
+    smux::coro::async_connection ca(exec, a, sp.fd[0], sp.fd[0]);
+    smux::coro::async_connection cb(exec, b, sp.fd[1], sp.fd[1]);
+
+    // larger than the socket buffer: the sender has to wait for the receiver
+    std::string big(1 << 20, '\x01');
+    std::string out1, out2;
+    exec.spawn(recv_all(cb, 2, 5, out2));
+    exec.spawn(recv_all(cb, 1, big.size(), out1));
+    exec.spawn(send_all(ca, 1, big));
+    exec.spawn(send_all(ca, 2, "hello"));
+    exec.run();
+
+    BOOST_TEST(out2 == "hello");
+    BOOST_TEST((out1 == big));
+}
+
+BOOST_AUTO_TEST_CASE(destroy_suspended)
+{
+    socket_pair sp;
+    smux::connection a(64, 64);
+    bool destroyed = false;
+    {
+        smux::coro::executor exec;
+        std::optional<smux::coro::async_connection> ca;
+        ca.emplace(exec, a, sp.fd[0], sp.fd[0]);
+
+        // the reader stays suspended, run() returns once its fd is not watched anymore
+        exec.spawn(recv_forever(*ca, destroyed));
+        exec.spawn(reset(ca));
+        exec.run();
+        BOOST_TEST(!destroyed);
+    }
+    BOOST_TEST(destroyed);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+#endif
+#endif
@@ -0,0 +1,50 @@
+// engine_test.cpp
+#include "lib_test.h"
+
+#include <string>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <smux_engine.hpp>
+
+BOOST_AUTO_TEST_SUITE(engine);
+
+BOOST_AUTO_TEST_CASE(send_receive)
+{
+    int fd[2];
+    BOOST_REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == 0);
+    for(int i = 0; i < 2; ++i)
+        ::fcntl(fd[i], F_SETFL, ::fcntl(fd[i], F_GETFL) | O_NONBLOCK);
+
+    smux::engine a(fd[0], fd[0], 64, 64);
+    smux::engine b(fd[1], fd[1], 64, 64);
+    std::string out1, out2;
+    b.on_data(1, [&out1](const char* buf, size_t count) { out1.append(buf, count); });
+    b.on_data(2, [&out2](const char* buf, size_t count) { out2.append(buf, count); });
+
+    // nothing to read yet
+    b.on_readable(fd[1]);
+    BOOST_TEST(b.want_read());
+    BOOST_TEST(out1.empty());
+
+    BOOST_TEST(!a.want_write());
+    BOOST_TEST(a.send(1, "hello", 5) == 5u);
+    BOOST_TEST(a.send(3, "ignored", 7) == 7u);
+    BOOST_TEST(a.send(2, "world", 5) == 5u);
+    BOOST_TEST(a.want_write());
+    a.on_writable(fd[0]);
+    BOOST_TEST(!a.want_write());
+
+    b.on_readable(fd[1]);
+    BOOST_TEST(out1 == "hello");
+    BOOST_TEST(out2 == "world");
+
+    ::close(fd[0]);
+    b.on_readable(fd[1]);
+    BOOST_TEST(b.eof());
+    BOOST_TEST(!b.want_read());
+    ::close(fd[1]);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -32,6 +32,10 @@ class TestLibFixture
         ssize_t writer_ret;
         unsigned writer_called = 0;
 
+        // elastic buffer segments
+        unsigned seg_allocated = 0;
+        unsigned seg_released = 0;
+
         TestLibFixture()
         {
             smux_init(&sender, &receiver);
@@ -73,6 +77,29 @@ class TestLibFixture
             return len;
         }
 
+        void enable_elastic(size_t segment_size, size_t max_size)
+        {
+            sender.elastic.alloc_fn = alloc_fn;
+            sender.elastic.release_fn = release_fn;
+            sender.elastic.alloc_fd = reinterpret_cast<void*>(this);
+            sender.elastic.segment_size = segment_size;
+            sender.elastic.max_size = max_size;
+        }
+
+        static void* alloc_fn(void *fd, size_t size)
+        {
+            TestLibFixture* f = reinterpret_cast<TestLibFixture*>(fd);
+            f->seg_allocated += 1;
+            return ::operator new(size);
+        }
+
+        static void release_fn(void *fd, void *ptr)
+        {
+            TestLibFixture* f = reinterpret_cast<TestLibFixture*>(fd);
+            f->seg_released += 1;
+            ::operator delete(ptr);
+        }
+
         ~TestLibFixture()
         {
             smux_free(&sender, &receiver);
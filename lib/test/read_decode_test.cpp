@@ -199,4 +199,44 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(read_into_short_buf_decode, R, readers)
     BOOST_TEST(recv == "5");
 }
 
+BOOST_AUTO_TEST_CASE_TEMPLATE(skip_unsubscribed, R, readers)
+{
+    R reader(this);
+
+    ssize_t ret;
+    // > AB on channel 0
+    // > 12\x0134 on channel \x42 (unsubscribed)
+    // > CD on channel 0
+    // > xyz on channel \x43
+    char muxed[] = "AB\x01\x42\x00\x05""12\x01\x00""34CD\x01\x43\x00\x03""xyz";
+    unsigned size = sizeof(muxed) - 1;
+
+    smux_subscribe(&receiver, 0x42, 0);
+
+    ret = reader.read(muxed, size);
+    BOOST_TEST(ret == size);
+
+    char recv[32];
+    smux_channel ch;
+
+    ret = smux_recv(&receiver, &ch, recv, sizeof(recv) - 1);
+    BOOST_TEST(ret == 2);
+    BOOST_TEST(ch == 0);
+    BOOST_TEST(memcmp(recv, "AB", ret) == 0);
+
+    // channel 0x42 is skipped entirely
+    ret = smux_recv(&receiver, &ch, recv, sizeof(recv) - 1);
+    BOOST_TEST(ret == 2);
+    BOOST_TEST(ch == 0);
+    BOOST_TEST(memcmp(recv, "CD", ret) == 0);
+
+    ret = smux_recv(&receiver, &ch, recv, sizeof(recv) - 1);
+    BOOST_TEST(ret == 3);
+    BOOST_TEST(ch == 0x43);
+    BOOST_TEST(memcmp(recv, "xyz", ret) == 0);
+
+    // buffer is empty now
+    BOOST_TEST(receiver._internal.rb_head == receiver._internal.rb_tail);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
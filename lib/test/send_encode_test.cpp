@@ -1,6 +1,8 @@
 // send_encode_test.cpp
 #include "lib_test.h"
 
+#include <string>
+
 struct SmuxWriter
 {
     SmuxWriter(TestLibFixture* fixture)
@@ -13,14 +15,15 @@ struct SmuxWriter
     TestLibFixture* _f;
 };
 
-/* not impl
 struct WriteBufWriter : public SmuxWriter
 {
     using SmuxWriter::SmuxWriter;
 
-    size_t write(char* buf, size_t count);
+    size_t write(char* buf, size_t count)
+    {
+        return smux_write_buf(&_f->sender, buf, count);
+    }
 };
-*/
 
 struct WriteFnWriter : public SmuxWriter
 {
@@ -37,7 +40,7 @@ struct WriteFnWriter : public SmuxWriter
     }
 };
 
-typedef boost::mpl::list</*WriteBufWriter, */ WriteFnWriter> writers;
+typedef boost::mpl::list<WriteBufWriter, WriteFnWriter> writers;
 
 
 BOOST_FIXTURE_TEST_SUITE(write_encode, TestLibFixture);
@@ -150,4 +153,288 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(write_to_short_buf, W, writers)
     BOOST_TEST(memcmp(buf, "CDEFGH", ret) == 0);
 }
 
+BOOST_AUTO_TEST_CASE_TEMPLATE(elastic_burst, W, writers)
+{
+    W writer(this);
+    size_t ret;
+
+    char buf[200];
+    size_t count = sizeof(buf) / sizeof(*buf);
+
+    std::string msg;
+    for(unsigned i = 0; i < 10; ++i)
+        msg += "0123456789";
+    enable_elastic(64, 0);
+
+    // send chunk larger than the write buffer
+    ret = smux_send(&sender, 0x42, msg.data(), msg.size());
+    BOOST_TEST(ret == msg.size());
+    BOOST_TEST(seg_allocated >= 2);
+    // pending bytes are counted encoded, in the write buffer and the segments
+    BOOST_TEST(smux_write_pending(&sender) == 108);
+
+    // write it out: the first frame fills the write buffer, the second the segments
+    ret = writer.write(buf, count);
+    BOOST_TEST(ret == 108);
+    BOOST_TEST(memcmp(buf, "\x01\x42\x00\x1b", 4) == 0);
+    BOOST_TEST(memcmp(buf + 4, msg.data(), 27) == 0);
+    BOOST_TEST(memcmp(buf + 31, "\x01\x42\x00\x49", 4) == 0);
+    BOOST_TEST(memcmp(buf + 35, msg.data() + 27, 73) == 0);
+
+    // all segments released
+    BOOST_TEST(seg_released == seg_allocated);
+    BOOST_TEST(sender._internal.seg_first == nullptr);
+    BOOST_TEST(sender._internal.seg_used == 0);
+    BOOST_TEST(smux_write_pending(&sender) == 0);
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(elastic_max_size, W, writers)
+{
+    W writer(this);
+    size_t ret;
+
+    char buf[200];
+    size_t count = sizeof(buf) / sizeof(*buf);
+
+    std::string msg(100, 'x');
+    enable_elastic(64, 64);
+
+    // only a single segment is allowed
+    ret = smux_send(&sender, 0, msg.data(), msg.size());
+    BOOST_TEST(ret > 31);
+    BOOST_TEST(ret < msg.size());
+    BOOST_TEST(seg_allocated == 1);
+
+    // maximum size reached
+    ret = smux_send(&sender, 0, "\x01", 1);
+    BOOST_TEST(ret == 0);
+
+    // write out everything
+    ret = writer.write(buf, count);
+    BOOST_TEST(seg_released == 1);
+
+    // now, there is space again
+    ret = smux_send(&sender, 0, "\x01", 1);
+    BOOST_TEST(ret == 1);
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(elastic_no_empty_frame, W, writers)
+{
+    W writer(this);
+    size_t ret;
+
+    char buf[200];
+    size_t count = sizeof(buf) / sizeof(*buf);
+
+    std::string msg(200, 'x');
+    enable_elastic(64, 64);
+
+    // capacity of the write buffer and the single segment
+    size_t capacity = smux_send(&sender, 0, msg.data(), msg.size());
+    writer.write(buf, count);
+
+    // leave just enough room in the segment for a frame header
+    ret = smux_send(&sender, 0, msg.data(), capacity - 4);
+    BOOST_TEST(ret == capacity - 4);
+    size_t used = sender._internal.seg_used;
+
+    // the header must not be stored without payload
+    ret = smux_send(&sender, 0x42, "abc", 3);
+    BOOST_TEST(ret == 0);
+    BOOST_TEST(sender._internal.seg_used == used);
+
+    ret = writer.write(buf, count);
+    BOOST_TEST(ret == capacity - 4);
+    BOOST_TEST(std::string(buf, ret) == msg.substr(0, ret));
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(reserve_commit, W, writers)
+{
+    W writer(this);
+    size_t ret;
+
+    char buf[100];
+    size_t count = sizeof(buf) / sizeof(*buf);
+
+    // produce payload in place
+    char* p = static_cast<char*>(smux_send_reserve(&sender, 0x42, 16));
+    BOOST_TEST(p != nullptr);
+    memcpy(p, "12\x01""34", 5);
+    ret = smux_send_commit(&sender, 5);
+    BOOST_TEST(ret == 5);
+
+    // channel 0 has no header
+    p = static_cast<char*>(smux_send_reserve(&sender, 0, 4));
+    BOOST_TEST(p != nullptr);
+    memcpy(p, "AB", 2);
+    ret = smux_send_commit(&sender, 2);
+    BOOST_TEST(ret == 2);
+
+    ret = writer.write(buf, count);
+    BOOST_TEST(ret == 12);
+    BOOST_TEST(memcmp(buf, "\x01\x42\x00\x05""12\x01\x00""34AB", ret) == 0);
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(reserve_write_commit, W, writers)
+{
+    W writer(this);
+    size_t ret;
+
+    char buf[100];
+    size_t count = sizeof(buf) / sizeof(*buf);
+
+    ret = smux_send(&sender, 0, "xy", 2);
+    BOOST_TEST(ret == 2);
+
+    // writing out everything in front of the reservation must not move it
+    char* p = static_cast<char*>(smux_send_reserve(&sender, 0x42, 16));
+    BOOST_TEST(p != nullptr);
+    ret = writer.write(buf, count);
+    BOOST_TEST(ret == 2);
+    BOOST_TEST(memcmp(buf, "xy", ret) == 0);
+
+    memcpy(p, "abc", 3);
+    ret = smux_send_commit(&sender, 3);
+    BOOST_TEST(ret == 3);
+
+    ret = writer.write(buf, count);
+    BOOST_TEST(ret == 7);
+    BOOST_TEST(memcmp(buf, "\x01\x42\x00\x03""abc", ret) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(reserve_commit_no_space)
+{
+    size_t ret;
+
+    // too large
+    BOOST_TEST(smux_send_reserve(&sender, 0x42, sizeof(write_buf)) == nullptr);
+
+    // no space left to escape in place
+    char* p = static_cast<char*>(smux_send_reserve(&sender, 0x42, sizeof(write_buf) - 5));
+    BOOST_TEST(p != nullptr);
+    memset(p, '\x01', sizeof(write_buf) - 5);
+    ret = smux_send_commit(&sender, sizeof(write_buf) - 5);
+    BOOST_TEST(ret == 0);
+    BOOST_TEST(sender._internal.wb_head == sender._internal.wb_tail);
+
+    // payload untouched
+    BOOST_TEST(p[0] == '\x01');
+    BOOST_TEST(p[sizeof(write_buf) - 6] == '\x01');
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(lazy_encode, W, writers)
+{
+    W writer(this);
+    size_t ret;
+
+    char buf[100];
+    size_t count = sizeof(buf)/sizeof(*buf);
+
+    sender.buffer.lazy = 1;
+
+    ret = smux_send(&sender, 0, "ABC\x01""DEF", 7);
+    BOOST_TEST(ret == 7);
+    ret = smux_send(&sender, 0x42, "123\x01", 4);
+    BOOST_TEST(ret == 4);
+    ret = smux_send(&sender, 0, "GH", 2);
+    BOOST_TEST(ret == 2);
+
+    // stored size is predictable: descriptor + raw payload
+    BOOST_TEST(sender._internal.wb_head == 3 * 3 + 13);
+
+    // encoded on writing
+    ret = writer.write(buf, count);
+    BOOST_TEST(ret == 19);
+    BOOST_TEST(memcmp(buf, "ABC\x01\x00""DEF\x01\x42\x00\x04""123\x01\x00""GH", ret) == 0);
+    BOOST_TEST(sender._internal.wb_head == sender._internal.wb_tail);
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(lazy_write_to_short_buf, W, writers)
+{
+    W writer(this);
+    size_t ret;
+
+    char buf[3];
+    size_t count = sizeof(buf) / sizeof(*buf);
+    std::string out;
+
+    sender.buffer.lazy = 1;
+    enable_elastic(64, 0);
+
+    const char msg[] = "\x01""0123456789\x01\x01""ABCDEFGHIJKLMNOPQRSTUVWXYZ\x01";
+    size_t msg_len = sizeof(msg)/sizeof(*msg) - 1;
+
+    ret = smux_send(&sender, 0x11, msg, msg_len);
+    BOOST_TEST(ret == msg_len);
+
+    // headers and escape sequences may be split
+    do
+    {
+        ret = writer.write(buf, count);
+        out.append(buf, ret);
+    } while(ret == count);
+
+    BOOST_TEST(out == std::string("\x01\x11\x00\x1c""\x01\x00""0123456789\x01\x00\x01\x00""ABCDEFGHIJKLMNO"
+                "\x01\x11\x00\x0c""PQRSTUVWXYZ\x01\x00", 52));
+    BOOST_TEST(seg_released == seg_allocated);
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(send_atomic, W, writers)
+{
+    W writer(this);
+    size_t ret;
+
+    char buf[100];
+    size_t count = sizeof(buf) / sizeof(*buf);
+
+    // 4 + 23 + 4 escapes = 31 bytes fit exactly
+    const char msg[] = "\x01""0123456789\x01""ABCDEFGHI\x01\x01";
+    size_t msg_len = sizeof(msg)/sizeof(*msg) - 1;
+    ret = smux_send_atomic(&sender, 0x42, msg, msg_len);
+    BOOST_TEST(ret == msg_len);
+
+    // full -> rejected without a header
+    ret = smux_send_atomic(&sender, 0x42, "x", 1);
+    BOOST_TEST(ret == 0);
+
+    ret = writer.write(buf, count);
+    BOOST_TEST(ret == 31);
+    BOOST_TEST(memcmp(buf, "\x01\x42\x00\x17""\x01\x00""0123456789\x01\x00""ABCDEFGHI\x01\x00\x01\x00", ret) == 0);
+
+    // too large for the write buffer
+    std::string large(40, 'x');
+    ret = smux_send_atomic(&sender, 0, large.data(), large.size());
+    BOOST_TEST(ret == 0);
+    BOOST_TEST(sender._internal.wb_head == sender._internal.wb_tail);
+
+    // but fits into the elastic buffer
+    enable_elastic(64, 0);
+    ret = smux_send_atomic(&sender, 0x42, msg, msg_len);
+    BOOST_TEST(ret == msg_len);
+    ret = smux_send_atomic(&sender, 0, large.data(), large.size());
+    BOOST_TEST(ret == large.size());
+    ret = writer.write(buf, count);
+    BOOST_TEST(ret == 71);
+    BOOST_TEST(memcmp(buf + 31, large.data(), large.size()) == 0);
+    BOOST_TEST(seg_released == seg_allocated);
+}
+
+BOOST_AUTO_TEST_CASE(lazy_reserve_commit)
+{
+    char buf[100];
+    size_t ret;
+
+    sender.buffer.lazy = 1;
+
+    char* p = static_cast<char*>(smux_send_reserve(&sender, 0x42, 28));
+    BOOST_TEST(p != nullptr);
+    memset(p, '\x01', 28);
+    ret = smux_send_commit(&sender, 28);
+    BOOST_TEST(ret == 28);
+
+    ret = smux_write_buf(&sender, buf, sizeof(buf));
+    BOOST_TEST(ret == 60);
+    BOOST_TEST(memcmp(buf, "\x01\x42\x00\x1c\x01\x00", 6) == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,360 @@
+// stream_test.cpp
+#include "lib_test.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include <smux.hpp>
+
+struct TestStreamFixture
+{
+    smux::connection conn;
+    std::string written; // data written by conn
+    size_t write_limit = static_cast<size_t>(-1); // max bytes accepted by the write function
+
+    TestStreamFixture()
+        : conn(64, 64)
+    {
+        conn.set_write_fn([this](const void* buf, size_t count) {
+            if(count > write_limit)
+                count = write_limit;
+            write_limit -= count;
+            written.append(static_cast<const char*>(buf), count);
+            return static_cast<ssize_t>(count);
+        });
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(streams, TestStreamFixture);
+
+BOOST_AUTO_TEST_CASE(ostream_formatted)
+{
+    smux::ostream os(conn, 0x42);
+    os << "abc" << 12 << '\x01';
+    BOOST_TEST(written.empty());
+    os.flush();
+    BOOST_TEST(os.good());
+    BOOST_TEST(written == std::string("\x01\x42\x00\x06""abc12\x01\x00", 11));
+}
+
+BOOST_AUTO_TEST_CASE(ostream_bulk)
+{
+    smux::ostream os(conn, 0);
+    std::string data(1000, 'x');
+
+    // larger than the smux buffer: written out while encoding
+    os.write(data.data(), data.size());
+    os.flush();
+    BOOST_TEST(os.good());
+    BOOST_TEST(written == data);
+}
+
+BOOST_AUTO_TEST_CASE(ostream_blocked)
+{
+    smux::ostream os(conn, 0);
+    std::string data(1000, 'x');
+
+    // write function stops accepting data
+    write_limit = 100;
+    os.write(data.data(), data.size());
+    BOOST_TEST(os.bad());
+    BOOST_TEST(written == data.substr(0, 100));
+}
+
+BOOST_AUTO_TEST_CASE(demux_channels)
+{
+    // > AB on channel 0, 123 on channel 1, CD on channel 0, 456 on channel 1, xyz on channel 2
+    std::string muxed("AB\x01\x01\x00\x03""123CD\x01\x01\x00\x03""456\x01\x02\x00\x03""xyz", 25);
+    size_t pos = 0;
+    conn.set_read_fn([&](void* buf, size_t count) {
+        // deliver in small pieces
+        size_t n = std::min<size_t>(std::min<size_t>(count, 5), muxed.size() - pos);
+        memcpy(buf, muxed.data() + pos, n);
+        pos += n;
+        return static_cast<ssize_t>(n);
+    });
+
+    smux::demux dm(conn);
+    auto& ch0 = dm.channel(0);
+    auto& ch1 = dm.channel(1);
+
+    // bulk read on channel 1 does not stop at channel changes
+    char buf[16];
+    ch1.read(buf, 6);
+    BOOST_TEST(ch1.gcount() == 6);
+    BOOST_TEST(std::string(buf, 6) == "123456");
+
+    // channel 0 has been buffered meanwhile
+    std::string s;
+    ch0 >> s;
+    BOOST_TEST(s == "ABCD");
+    BOOST_TEST(ch0.eof());
+
+    // channel 2 not subscribed
+    ch1.read(buf, 1);
+    BOOST_TEST(ch1.gcount() == 0);
+    BOOST_TEST(pos == muxed.size());
+}
+
+BOOST_AUTO_TEST_CASE(template_callables)
+{
+    std::string out;
+    auto fn = [&out](const void* buf, size_t count) {
+        out.append(static_cast<const char*>(buf), count);
+        return static_cast<ssize_t>(count);
+    };
+    smux::basic_sender<decltype(fn)> s(fn, 64);
+
+    smux::ostream os(s, 0x42);
+    os << "abc" << std::flush;
+    BOOST_TEST(out == std::string("\x01\x42\x00\x03""abc", 7));
+}
+
+BOOST_AUTO_TEST_CASE(connection_move)
+{
+    write_limit = 0;
+    BOOST_TEST(conn.send(0x42, "abc", 3) == 3);
+
+    // pending data and write function move along
+    smux::connection moved(std::move(conn));
+    write_limit = static_cast<size_t>(-1);
+    BOOST_TEST(moved.write() == 0);
+    BOOST_TEST(written == std::string("\x01\x42\x00\x03""abc", 7));
+
+    conn = std::move(moved);
+    BOOST_TEST(conn.send(0x42, "d", 1) == 1);
+    BOOST_TEST(conn.write() == 0);
+    BOOST_TEST(written.size() == 12u);
+}
+
+BOOST_AUTO_TEST_CASE(resize_buffers)
+{
+    // not while data is pending
+    write_limit = 0;
+    BOOST_TEST(conn.send(0x42, "abc", 3) == 3);
+    BOOST_TEST(!conn.resize_write_buf(256));
+    BOOST_TEST(conn.write_buf_size() == 64u);
+    write_limit = static_cast<size_t>(-1);
+    BOOST_TEST(conn.write() == 0);
+
+    // empty -> possible
+    BOOST_TEST(conn.resize_write_buf(256));
+    BOOST_TEST(conn.write_buf_size() == 256u);
+    std::string data(200, 'x');
+    BOOST_TEST(conn.send(0x42, data.data(), data.size()) == data.size());
+    BOOST_TEST(conn.write() == 0);
+    BOOST_TEST(written.size() == 7u + 4u + 200u);
+
+    // the receiver keeps its decoder state across a resize
+    std::string in;
+    size_t pos = 0;
+    conn.set_read_fn([&](void* buf, size_t count) {
+        count = std::min(count, written.size() - pos);
+        std::memcpy(buf, written.data() + pos, count);
+        pos += count;
+        return static_cast<ssize_t>(count);
+    });
+    char buf[256];
+    smux_channel ch;
+    conn.read();
+    while(size_t n = conn.recv(&ch, buf, sizeof(buf)))
+        in.append(buf, n);
+    BOOST_TEST(conn.resize_read_buf(16));
+    BOOST_TEST(conn.read_buf_size() == 16u);
+    while(pos < written.size())
+    {
+        conn.read();
+        while(size_t n = conn.recv(&ch, buf, sizeof(buf)))
+            in.append(buf, n);
+    }
+    BOOST_TEST(in == "abc" + data);
+    BOOST_CHECK_THROW(conn.resize_read_buf(8), smux::config_error);
+}
+
+BOOST_AUTO_TEST_CASE(pooled_connection)
+{
+    smux::buffer_pool pool(64);
+    {
+        smux::pooled_connection c(64, 64, pool);
+    }
+    BOOST_TEST(pool.free_count() == 2u);
+
+    // buffers are recycled
+    smux::pooled_connection c(64, 64, pool);
+    BOOST_TEST(pool.free_count() == 0u);
+
+    // elastic segments come from the pool as well
+    c.set_elastic(pool);
+    c.set_write_fn([](const void*, size_t) { return static_cast<ssize_t>(0); });
+    std::string data(200, 'x');
+    BOOST_TEST(c.send(0, data.data(), data.size()) == static_cast<ssize_t>(data.size()));
+    smux::pooled_connection moved(std::move(c));
+    moved = smux::pooled_connection(64, 64, pool);
+    BOOST_TEST(pool.free_count() >= 4u);
+}
+
+BOOST_AUTO_TEST_CASE(channel_handles)
+{
+    auto a = conn.open_channel(1, 8);
+    auto b = conn.open_channel(2, 8);
+
+    // queued per channel, one frame per flush
+    BOOST_TEST(a.send("ab", 2) == 2u);
+    BOOST_TEST(b.send("xy", 2) == 2u);
+    BOOST_TEST(a.send("c", 1) == 1u);
+    BOOST_TEST(a.pending() == 3u);
+    BOOST_TEST(a.writable() == 5u);
+    BOOST_TEST(written.empty());
+    BOOST_TEST(a.flush());
+    BOOST_TEST(b.flush());
+    BOOST_TEST(written == std::string("\x01\x01\x00\x03""abc\x01\x02\x00\x02xy", 13));
+
+    // receive the frames again, channel 3 is not opened
+    std::string input = written + std::string("\x01\x03\x00\x01z", 5);
+    conn.set_read_fn([&input](void* buf, size_t count) {
+        count = std::min(count, input.size());
+        std::memcpy(buf, input.data(), count);
+        input.erase(0, count);
+        return static_cast<ssize_t>(count);
+    });
+    char buf[16];
+    BOOST_TEST(b.try_recv(buf, sizeof(buf)) == 0u);
+    BOOST_TEST(b.recv(buf, sizeof(buf)) == 2u);
+    BOOST_TEST(std::string(buf, 2) == "xy");
+    BOOST_TEST(a.readable() == 3u);
+    BOOST_TEST(a.try_recv(buf, 2) == 2u);
+    BOOST_TEST(a.recv(buf, sizeof(buf)) == 1u);
+    BOOST_TEST(buf[0] == 'c');
+    BOOST_TEST(a.recv(buf, sizeof(buf)) == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(channel_partial_push)
+{
+    auto a = conn.open_channel(1, 16);
+    std::string data;
+    for(int i = 0; i < 64; ++i)
+        data += static_cast<char>('a' + i % 26);
+
+    // smux accepts only parts of the queue while the write function is blocked
+    write_limit = 0;
+    size_t queued = 0;
+    while(queued < data.size())
+    {
+        size_t n = a.try_send(data.data() + queued, std::min<size_t>(5, data.size() - queued));
+        if(!n)
+            break;
+        queued += n;
+    }
+    BOOST_TEST(queued > 16u);
+    BOOST_TEST(queued < data.size());
+    BOOST_TEST(a.pending() <= 16u);
+    write_limit = static_cast<size_t>(-1);
+    BOOST_TEST(a.send(data.data() + queued, data.size() - queued) == data.size() - queued);
+    BOOST_TEST(a.flush());
+    BOOST_TEST(a.pending() == 0u);
+
+    // received in order
+    std::string input = written;
+    conn.set_read_fn([&input](void* buf, size_t count) {
+        count = std::min(count, input.size());
+        std::memcpy(buf, input.data(), count);
+        input.erase(0, count);
+        return static_cast<ssize_t>(count);
+    });
+    std::string received;
+    char buf[32];
+    while(size_t n = a.recv(buf, sizeof(buf)))
+        received.append(buf, n);
+    BOOST_TEST(received == data);
+}
+
+BOOST_AUTO_TEST_CASE(typed_channels)
+{
+    struct sample
+    {
+        uint32_t id;
+        double value;
+        char tag[4];
+    };
+    smux::typed_channel<sample> tx(conn, 5);
+    for(uint32_t i = 0; i < 3; ++i)
+    {
+        sample s = { i, i * 0.5, "\x01\x01\x01" };
+        BOOST_TEST(tx.send(s));
+    }
+    BOOST_TEST(tx.handle().flush());
+
+    // feed back in small pieces, so frames arrive split
+    std::string input = written;
+    conn.set_read_fn([&input](void* buf, size_t count) {
+        count = std::min<size_t>(count, std::min<size_t>(input.size(), 5));
+        std::memcpy(buf, input.data(), count);
+        input.erase(0, count);
+        return static_cast<ssize_t>(count);
+    });
+    smux::typed_channel<sample> rx(conn, 5);
+    BOOST_TEST(rx.try_recv() == nullptr);
+    for(uint32_t i = 0; i < 3; ++i)
+    {
+        const sample* s = rx.recv();
+        BOOST_REQUIRE(s);
+        BOOST_TEST(s->id == i);
+        BOOST_TEST(s->value == i * 0.5);
+        BOOST_TEST(std::string(s->tag) == "\x01\x01\x01");
+    }
+    BOOST_TEST(rx.recv() == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(typed_channel_oversized)
+{
+    // larger than the write buffer of the connection
+    struct sample
+    {
+        char data[100];
+    };
+    sample s = {};
+    smux::typed_channel<sample> tx(conn, 5);
+    BOOST_TEST(!tx.try_send(s));
+    BOOST_TEST(!tx.send(s));
+    BOOST_TEST(written.empty());
+}
+
+BOOST_AUTO_TEST_CASE(typed_channel_view)
+{
+    struct sample
+    {
+        uint16_t id;
+        char tag;
+    };
+    smux::typed_channel<sample> tx(conn, 6);
+    for(uint16_t i = 0; i < 4; ++i)
+        BOOST_TEST(tx.send(sample{i, '\x01'}));
+    BOOST_TEST(tx.handle().flush());
+
+    std::string input = written;
+    conn.set_read_fn([&input](void* buf, size_t count) {
+        count = std::min(count, input.size());
+        std::memcpy(buf, input.data(), count);
+        input.erase(0, count);
+        return static_cast<ssize_t>(count);
+    });
+    smux::typed_channel<sample> rx(conn, 6);
+    const sample* first = rx.recv();
+    BOOST_REQUIRE(first);
+    BOOST_TEST(first->id == 0);
+    BOOST_TEST(rx.readable() == 3);
+
+    // messages are views into the channel buffer, one after the other
+    for(uint16_t i = 1; i < 4; ++i)
+    {
+        const sample* s = rx.try_recv();
+        BOOST_REQUIRE(s);
+        BOOST_TEST(s == first + i);
+        BOOST_TEST(s->id == i);
+        BOOST_TEST(s->tag == '\x01');
+    }
+    BOOST_TEST(rx.try_recv() == nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
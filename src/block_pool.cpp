@@ -0,0 +1,104 @@
+// block_pool.cpp
+#include <new>
+
+#include "block_pool.h"
+
+using namespace smux_client;
+
+// blocks cached by the current thread (plain data, so it is usable during exit)
+static thread_local void* cache_head = nullptr;
+static thread_local unsigned cache_count = 0;
+
+block_pool& block_pool::get()
+{
+    static block_pool* instance = new block_pool;
+    return *instance;
+}
+
+void* block_pool::allocate()
+{
+    if(!cache_count)
+        _refill(CACHE_SIZE / 2);
+
+    void* block;
+    if(cache_count)
+    {
+        node* n = static_cast<node*>(cache_head);
+        cache_head = n->next;
+        --cache_count;
+        block = n;
+    } else
+    {
+        block = ::operator new(BLOCK_SIZE);
+        _system_allocs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    _allocs.fetch_add(1, std::memory_order_relaxed);
+    std::size_t in_use = _in_use.fetch_add(1, std::memory_order_relaxed) + 1;
+    std::size_t peak = _peak.load(std::memory_order_relaxed);
+    while(in_use > peak && !_peak.compare_exchange_weak(peak, in_use, std::memory_order_relaxed))
+        ;
+    return block;
+}
+
+void block_pool::deallocate(void* block)
+{
+    _in_use.fetch_sub(1, std::memory_order_relaxed);
+
+    node* n = static_cast<node*>(block);
+    n->next = static_cast<node*>(cache_head);
+    cache_head = n;
+    if(++cache_count > CACHE_SIZE)
+        _drain(CACHE_SIZE / 2);
+}
+
+void block_pool::flush_cache()
+{
+    _drain(cache_count);
+}
+
+block_pool::counters block_pool::stats() const
+{
+    counters c;
+    c.allocs = _allocs.load(std::memory_order_relaxed);
+    c.system_allocs = _system_allocs.load(std::memory_order_relaxed);
+    c.system_frees = _system_frees.load(std::memory_order_relaxed);
+    c.in_use = _in_use.load(std::memory_order_relaxed);
+    c.peak = _peak.load(std::memory_order_relaxed);
+    return c;
+}
+
+void block_pool::_refill(unsigned count)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    while(count-- && _free)
+    {
+        node* n = _free;
+        _free = n->next;
+        --_free_count;
+        n->next = static_cast<node*>(cache_head);
+        cache_head = n;
+        ++cache_count;
+    }
+}
+
+void block_pool::_drain(unsigned count)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    while(count-- && cache_count)
+    {
+        node* n = static_cast<node*>(cache_head);
+        cache_head = n->next;
+        --cache_count;
+        if(_free_count < MAX_FREE)
+        {
+            n->next = _free;
+            _free = n;
+            ++_free_count;
+        } else
+        {
+            ::operator delete(n);
+            _system_frees.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,116 @@
+/// \file block_pool.h
+#ifndef _BLOCK_POOL_H_INCLUDED_
+#define _BLOCK_POOL_H_INCLUDED_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+namespace smux_client
+{
+    /**
+     * \brief                   process-wide pool of fixed-size I/O blocks
+     *
+     * All buffers of the runtime system that hold data in flight are made of blocks from
+     * this pool: the chunks of channel output queues and the elastic segments of the smux
+     * write buffer. Released blocks are kept for reuse, so a steady state does not allocate.
+     *
+     * Each thread caches up to CACHE_SIZE blocks, which are handed out and taken back without
+     * locking. Only when its cache runs empty or full, a thread exchanges half of it with the
+     * shared free list under a mutex. The shared free list keeps at most MAX_FREE blocks, further
+     * blocks are returned to the system.
+     */
+    class block_pool
+    {
+        public:
+            enum
+            {
+                BLOCK_SIZE = 4096, ///< size of a block in bytes
+                CACHE_SIZE = 16, ///< maximum number of blocks cached by a thread
+                MAX_FREE = 256, ///< maximum number of blocks on the shared free list
+            };
+
+            /// allocation counters
+            struct counters
+            {
+                std::uint64_t allocs = 0; ///< blocks handed out
+                std::uint64_t system_allocs = 0; ///< blocks allocated from the system
+                std::uint64_t system_frees = 0; ///< blocks returned to the system
+                std::size_t in_use = 0; ///< blocks currently handed out
+                std::size_t peak = 0; ///< maximum of in_use
+            };
+
+            /**
+             * \brief                   get the process-wide pool
+             *
+             * The pool is never destroyed, so blocks may still be released during static
+             * destruction.
+             */
+            static block_pool& get();
+
+            /**
+             * \brief                   get a block of BLOCK_SIZE bytes
+             * \throw std::bad_alloc
+             */
+            void* allocate();
+
+            /**
+             * \brief                   return a block obtained from allocate()
+             */
+            void deallocate(void* block);
+
+            /**
+             * \brief                   return the blocks cached by the calling thread
+             *
+             * Call before a thread exits.
+             */
+            void flush_cache();
+
+            /**
+             * \brief                   get a snapshot of the allocation counters
+             */
+            counters stats() const;
+
+        private:
+            struct node
+            {
+                node* next;
+            };
+
+            block_pool() = default;
+
+            // sorry, no copy
+            block_pool(block_pool const&) = delete;
+            block_pool& operator=(block_pool const&) = delete;
+
+            // move up to count blocks from the shared free list to the cache of this thread
+            void _refill(unsigned count);
+            // move count blocks from the cache of this thread to the shared free list
+            void _drain(unsigned count);
+
+            std::mutex _mutex; // protects _free and _free_count
+            node* _free = nullptr;
+            std::size_t _free_count = 0;
+
+            std::atomic<std::uint64_t> _allocs{0};
+            std::atomic<std::uint64_t> _system_allocs{0};
+            std::atomic<std::uint64_t> _system_frees{0};
+            std::atomic<std::size_t> _in_use{0};
+            std::atomic<std::size_t> _peak{0};
+    };
+
+    /**
+     * \brief                   print pool counters in a single line
+     */
+    inline void print_pool_counters(std::ostream& os, block_pool::counters const& c)
+    {
+        os << "pool: in use=" << c.in_use << " peak=" << c.peak << " blocks"
+            << " allocs=" << c.allocs
+            << " system allocs=" << c.system_allocs << " frees=" << c.system_frees;
+    }
+
+} // namespace smux_client
+
+#endif // ifndef _BLOCK_POOL_H_INCLUDED_
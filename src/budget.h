@@ -0,0 +1,192 @@
+/// \file budget.h
+#ifndef _BUDGET_H_INCLUDED_
+#define _BUDGET_H_INCLUDED_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "errors.h"
+
+namespace smux_client
+{
+    /**
+     * \brief                   action taken when pending channel output exceeds its budget
+     */
+    enum class budget_policy
+    {
+        block, ///< stop reading the master until the output drains
+        drop, ///< drop the oldest pending data of the channel
+        spill, ///< move further data to a temporary file
+    };
+
+    /**
+     * \brief                   limits for pending channel output
+     */
+    struct budget_config
+    {
+        std::size_t channel_limit = 0; ///< bytes per channel (0 = unlimited)
+        std::size_t global_limit = 0; ///< bytes of all channels (0 = unlimited)
+        budget_policy policy = budget_policy::block; ///< action when a limit is reached
+    };
+
+    /**
+     * \brief                   how often the budget policies triggered
+     */
+    struct budget_counters
+    {
+        std::uint64_t blocks = 0; ///< times the master has been paused
+        std::uint64_t drops = 0; ///< times data has been dropped
+        std::uint64_t dropped_bytes = 0;
+        std::uint64_t spills = 0; ///< times data has been moved to a spill file
+        std::uint64_t spilled_bytes = 0;
+        std::size_t pending = 0; ///< bytes currently pending in memory (all channels)
+        std::size_t peak = 0; ///< maximum of pending
+    };
+
+    /**
+     * \brief                   parse the name of a budget policy
+     * \param name              "block", "drop" or "spill"
+     * \return                  policy
+     * \throw                   config_error
+     */
+    inline budget_policy parse_budget_policy(std::string const& name)
+    {
+        if(name == "block")
+            return budget_policy::block;
+        if(name == "drop")
+            return budget_policy::drop;
+        if(name == "spill")
+            return budget_policy::spill;
+        throw config_error("unknown budget policy: " + name);
+    }
+
+    /**
+     * \brief                   get the name of a budget policy
+     */
+    inline char const* budget_policy_name(budget_policy policy)
+    {
+        switch(policy)
+        {
+            case budget_policy::block:
+                return "block";
+            case budget_policy::drop:
+                return "drop";
+            case budget_policy::spill:
+                return "spill";
+        }
+        return "unknown";
+    }
+
+    /**
+     * \brief                   print budget counters in a single line
+     */
+    inline void print_budget_counters(std::ostream& os, budget_counters const& c)
+    {
+        os << "budget: pending=" << c.pending << " peak=" << c.peak
+            << " blocks=" << c.blocks
+            << " drops=" << c.drops << " (" << c.dropped_bytes << " bytes)"
+            << " spills=" << c.spills << " (" << c.spilled_bytes << " bytes)";
+    }
+
+    /**
+     * \brief                   FIFO of bytes in an anonymous temporary file
+     *
+     * The file is created on first use and truncated whenever it runs empty.
+     */
+    class spill_file
+    {
+        public:
+            spill_file() = default;
+
+            // sorry, no copy
+            spill_file(spill_file const&) = delete;
+            spill_file& operator=(spill_file const&) = delete;
+
+            ~spill_file()
+            {
+                if(_fl)
+                    std::fclose(_fl);
+            }
+
+            /// number of bytes in the file
+            std::size_t size() const
+            {
+                return _woff - _roff;
+            }
+
+            /// true if the file holds no data
+            bool empty() const
+            {
+                return _woff == _roff;
+            }
+
+            /**
+             * \brief                   append data
+             * \throw                   system_error
+             */
+            void append(const char* data, std::size_t count)
+            {
+                if(!_fl)
+                {
+                    _fl = std::tmpfile();
+                    if(!_fl)
+                        throw system_error(errno, "creating spill file failed");
+                }
+                while(count > 0)
+                {
+                    auto ret = ::pwrite(fileno(_fl), data, count, static_cast<off_t>(_woff));
+                    if(ret < 0)
+                    {
+                        if(errno == EINTR)
+                            continue;
+                        throw system_error(errno, "writing spill file failed");
+                    }
+                    _woff += ret;
+                    data += ret;
+                    count -= ret;
+                }
+            }
+
+            /**
+             * \brief                   take data from the front
+             * \return                  number of bytes copied to buf
+             * \throw                   system_error
+             */
+            std::size_t take(char* buf, std::size_t count)
+            {
+                if(count > size())
+                    count = size();
+                if(!count)
+                    return 0;
+                ssize_t ret;
+                do
+                {
+                    ret = ::pread(fileno(_fl), buf, count, static_cast<off_t>(_roff));
+                } while(ret < 0 && errno == EINTR);
+                if(ret < 0)
+                    throw system_error(errno, "reading spill file failed");
+                _roff += ret;
+                if(_roff == _woff)
+                {
+                    // empty -> start over
+                    _roff = _woff = 0;
+                    if(ftruncate(fileno(_fl), 0)) {} // just a hint
+                }
+                return static_cast<std::size_t>(ret);
+            }
+
+        private:
+            std::FILE* _fl = nullptr;
+            std::size_t _woff = 0; // write offset
+            std::size_t _roff = 0; // read offset
+    };
+
+} // namespace smux_client
+
+#endif // ifndef _BUDGET_H_INCLUDED_
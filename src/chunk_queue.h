@@ -0,0 +1,155 @@
+/// \file chunk_queue.h
+#ifndef _CHUNK_QUEUE_H_INCLUDED_
+#define _CHUNK_QUEUE_H_INCLUDED_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include <sys/uio.h>
+
+#include "block_pool.h"
+
+namespace smux_client
+{
+    /**
+     * \brief                   FIFO byte queue made of fixed-size chunks
+     *
+     * Appending copies into the last chunk (adding chunks as needed) and consuming advances
+     * within the first chunk, so neither moves queued data. Each chunk occupies one block of
+     * the block_pool and goes back to the pool as soon as it is consumed, so an empty queue
+     * holds no memory. The queued data can be written with writev() using fill_iovec().
+     */
+    class chunk_queue
+    {
+        public:
+            enum
+            {
+                /// payload bytes per chunk (a block minus the chunk header)
+                CHUNK_SIZE = block_pool::BLOCK_SIZE - sizeof(void*) - 2 * sizeof(std::size_t),
+            };
+
+            chunk_queue() = default;
+
+            // sorry, no copy
+            chunk_queue(chunk_queue const&) = delete;
+            chunk_queue& operator=(chunk_queue const&) = delete;
+
+            /**
+             * \brief                   dtor
+             */
+            ~chunk_queue()
+            {
+                while(_first)
+                    _pop_chunk();
+            }
+
+            /// number of queued bytes
+            std::size_t size() const
+            {
+                return _size;
+            }
+
+            /// true if no data is queued
+            bool empty() const
+            {
+                return _size == 0;
+            }
+
+            /**
+             * \brief                   append data to the end of the queue
+             * \param data              data
+             * \param count             number of bytes
+             */
+            void append(const char* data, std::size_t count)
+            {
+                while(count > 0)
+                {
+                    if(!_last || _last->tail == CHUNK_SIZE)
+                        _push_chunk();
+                    std::size_t n = std::min<std::size_t>(count, CHUNK_SIZE - _last->tail);
+                    std::memcpy(_last->data + _last->tail, data, n);
+                    _last->tail += n;
+                    _size += n;
+                    data += n;
+                    count -= n;
+                }
+            }
+
+            /**
+             * \brief                   remove data from the front of the queue
+             * \param count             number of bytes (at most size())
+             */
+            void consume(std::size_t count)
+            {
+                count = std::min(count, _size);
+                _size -= count;
+                while(count > 0)
+                {
+                    std::size_t n = std::min(count, _first->tail - _first->head);
+                    _first->head += n;
+                    count -= n;
+                    if(_first->head == _first->tail)
+                        _pop_chunk();
+                }
+            }
+
+            /**
+             * \brief                   describe the queued data for writev()
+             * \param[out] iov          array of at least max entries
+             * \param max               maximum number of entries to fill
+             * \return                  number of filled entries
+             */
+            int fill_iovec(struct iovec* iov, int max) const
+            {
+                int n = 0;
+                for(chunk* c = _first; c && n < max; c = c->next)
+                {
+                    iov[n].iov_base = c->data + c->head;
+                    iov[n].iov_len = c->tail - c->head;
+                    ++n;
+                }
+                return n;
+            }
+
+        private:
+            struct chunk
+            {
+                chunk* next;
+                std::size_t head; // first queued byte
+                std::size_t tail; // end of queued bytes
+                char data[CHUNK_SIZE];
+            };
+
+            static_assert(sizeof(chunk) <= block_pool::BLOCK_SIZE, "chunk must fit into a block");
+
+            // append an empty chunk
+            void _push_chunk()
+            {
+                chunk* c = static_cast<chunk*>(block_pool::get().allocate());
+                c->next = nullptr;
+                c->head = c->tail = 0;
+                if(_last)
+                    _last->next = c;
+                else
+                    _first = c;
+                _last = c;
+            }
+
+            // release the first chunk
+            void _pop_chunk()
+            {
+                chunk* c = _first;
+                _first = c->next;
+                if(!_first)
+                    _last = nullptr;
+                block_pool::get().deallocate(c);
+            }
+
+            chunk* _first = nullptr; // oldest chunk (next to consume)
+            chunk* _last = nullptr; // newest chunk (next to append to)
+            std::size_t _size = 0;
+    };
+} // namespace smux_client
+
+#endif // ifndef _CHUNK_QUEUE_H_INCLUDED_
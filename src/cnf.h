@@ -7,7 +7,9 @@
 
 #include <smux.hpp> // smux_channel
 
+#include "budget.h"
 #include "file_factory.h"
+#include "poller.h"
 
 namespace smux_client
 {
@@ -67,6 +69,60 @@ namespace smux_client
                 return _channels;
             }
 
+            /**
+             * \brief                   get the event notification mechanism
+             * \return                  poller type (default: epoll)
+             */
+            poller_type backend() const
+            {
+                return _backend;
+            }
+
+            /**
+             * \brief                   check if RX and TX run in separate threads
+             * \return                  true if split (default: false)
+             */
+            bool split_threads() const
+            {
+                return _split_threads;
+            }
+
+            /**
+             * \brief                   get the number of bytes read from a file at once
+             * \return                  read size (0 = runtime default)
+             */
+            std::size_t read_size() const
+            {
+                return _read_size;
+            }
+
+            /**
+             * \brief                   get the size of the smux buffers
+             * \return                  size (0 = runtime default)
+             */
+            std::size_t smux_buffer_size() const
+            {
+                return _smux_buffer_size;
+            }
+
+            /**
+             * \brief                   check if buffer sizes adapt to the traffic
+             * \return                  true if adaptive (default: false)
+             */
+            bool adaptive_buffers() const
+            {
+                return _adaptive_buffers;
+            }
+
+            /**
+             * \brief                   get the limits for pending channel output
+             * \return                  budget (default: unlimited)
+             */
+            budget_config const& budget() const
+            {
+                return _budget;
+            }
+
         protected:
             /**
              * \brief                   define the master file symmetrically
@@ -118,9 +174,87 @@ namespace smux_client
              */
             void reset_channel(smux_channel ch);
 
+            /**
+             * \brief                   set the event notification mechanism
+             * \param type              poller type
+             */
+            void set_backend(poller_type type)
+            {
+                _backend = type;
+            }
+
+            /**
+             * \brief                   run RX and TX in separate threads
+             * \param split             true to split
+             */
+            void set_split_threads(bool split)
+            {
+                _split_threads = split;
+            }
+
+            /**
+             * \brief                   set the number of bytes read from a file at once
+             * \param size              read size (0 = runtime default)
+             */
+            void set_read_size(std::size_t size)
+            {
+                _read_size = size;
+            }
+
+            /**
+             * \brief                   set the size of the smux buffers
+             * \param size              size (0 = runtime default)
+             */
+            void set_smux_buffer_size(std::size_t size)
+            {
+                _smux_buffer_size = size;
+            }
+
+            /**
+             * \brief                   let buffer sizes adapt to the traffic
+             * \param adaptive          true to adapt
+             */
+            void set_adaptive_buffers(bool adaptive)
+            {
+                _adaptive_buffers = adaptive;
+            }
+
+            /**
+             * \brief                   set the pending output limit of each channel
+             * \param limit             number of bytes (0 = unlimited)
+             */
+            void set_channel_budget(std::size_t limit)
+            {
+                _budget.channel_limit = limit;
+            }
+
+            /**
+             * \brief                   set the pending output limit of all channels together
+             * \param limit             number of bytes (0 = unlimited)
+             */
+            void set_global_budget(std::size_t limit)
+            {
+                _budget.global_limit = limit;
+            }
+
+            /**
+             * \brief                   set the action taken when a budget is exceeded
+             * \param policy            budget policy
+             */
+            void set_budget_policy(budget_policy policy)
+            {
+                _budget.policy = policy;
+            }
+
         private:
             channel_map _channels;
             channel _master_file;
+            poller_type _backend = poller_type::epoll;
+            budget_config _budget;
+            bool _split_threads = false;
+            std::size_t _read_size = 0;
+            std::size_t _smux_buffer_size = 0;
+            bool _adaptive_buffers = false;
     };
 } // namespace smux_client
 
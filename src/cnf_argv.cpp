@@ -1,4 +1,5 @@
 // cnf_argv.cpp
+#include <limits>
 #include <utility> // std::move
 #include <unistd.h> // getopt
 
@@ -10,6 +11,7 @@ using namespace smux_client;
 static channel_type parse_channel_spec(std::string const& spec, smux_channel& ch, file_def& flA, file_def& flB);
 static channel_type parse_file_specs(std::string const& spec, file_def& flA, file_def& flB);
 static bool parse_file_spec(std::string const& spec, file_def& fl);
+static std::size_t parse_size(std::string const& spec);
 
 void cnf_argv::parse(int argc, char *const argv[])
 {
@@ -19,7 +21,7 @@ void cnf_argv::parse(int argc, char *const argv[])
 
     // loop over the rest
     int optres;
-    while((optres = getopt(argc, argv, ":dhm:c:")) != -1)
+    while((optres = getopt(argc, argv, ":dhtam:c:b:q:Q:o:r:s:")) != -1)
     {
         switch(optres)
         {
@@ -29,6 +31,28 @@ void cnf_argv::parse(int argc, char *const argv[])
             case 'd':
                 _debug_level += 1;
                 break;
+            case 't':
+                set_split_threads(true);
+                break;
+            case 'a':
+                set_adaptive_buffers(true);
+                break;
+            case 'r':
+                {
+                    std::size_t size = parse_size(optarg);
+                    if(size == 0)
+                        throw config_error(std::string("read size must not be 0: ") + optarg);
+                    set_read_size(size);
+                }
+                break;
+            case 's':
+                {
+                    std::size_t size = parse_size(optarg);
+                    if(size < 16)
+                        throw config_error(std::string("smux buffer size must be at least 16: ") + optarg);
+                    set_smux_buffer_size(size);
+                }
+                break;
             case 'm':
                 {
                     // parse file definition
@@ -74,6 +98,18 @@ void cnf_argv::parse(int argc, char *const argv[])
                     }
                 }
                 break;
+            case 'b':
+                set_backend(parse_poller_type(optarg));
+                break;
+            case 'q':
+                set_channel_budget(parse_size(optarg));
+                break;
+            case 'Q':
+                set_global_budget(parse_size(optarg));
+                break;
+            case 'o':
+                set_budget_policy(parse_budget_policy(optarg));
+                break;
             case ':':
                 throw config_error(std::string("missing argument for -") + (char)optopt);
             case '?':
@@ -159,3 +195,34 @@ static bool parse_file_spec(std::string const& spec, file_def& fl_def)
 
     return true;
 }
+
+// number of bytes with an optional suffix k, M or G
+static std::size_t parse_size(std::string const& spec)
+{
+    // std::stoull() would skip white space and accept a sign (wrapping "-1" to the maximum)
+    if(spec.empty() || spec[0] < '0' || spec[0] > '9')
+        throw config_error("unable to parse size: " + spec);
+
+    std::size_t pos;
+    unsigned long long size;
+    try
+    {
+        size = std::stoull(spec, &pos);
+    } catch(...)
+    {
+        throw config_error("unable to parse size: " + spec);
+    }
+    std::string const suffix = spec.substr(pos);
+    unsigned shift = 0;
+    if(suffix == "k" || suffix == "K")
+        shift = 10;
+    else if(suffix == "M")
+        shift = 20;
+    else if(suffix == "G")
+        shift = 30;
+    else if(!suffix.empty())
+        throw config_error("unable to parse size: " + spec);
+    if(size > std::numeric_limits<std::size_t>::max() >> shift)
+        throw config_error("size too large: " + spec);
+    return static_cast<std::size_t>(size << shift);
+}
@@ -63,6 +63,12 @@ void smux_client::print_channel_def(std::ostream& os, smux_client::cnf::channel
 void smux_client::print_config(std::ostream& os, smux_client::cnf const& conf)
 {
     using namespace smux_client;
+    os << "backend: " << poller_type_name(conf.backend()) << "\n";
+    os << "threads: " << (conf.split_threads() ? "RX/TX split" : "single") << "\n";
+    os << "buffers: read=" << conf.read_size() << " smux=" << conf.smux_buffer_size()
+        << (conf.adaptive_buffers() ? " adaptive" : "") << " (0 = default)\n";
+    os << "budget: channel=" << conf.budget().channel_limit << " global=" << conf.budget().global_limit
+        << " policy=" << budget_policy_name(conf.budget().policy) << "\n";
     os << "master: ";
     print_channel_def(os, conf.master());
     os << "\n" << "channels:\n";
@@ -4,8 +4,9 @@
 MYDIR                   := $(dir $(lastword $(MAKEFILE_LIST)))
 
 SRC_CXX                 := file_factory.cpp files.cpp rt.cpp cnf.cpp cnf_argv.cpp \
-                           debug.cpp
+                           debug.cpp poller.cpp log.cpp block_pool.cpp
 SRC_CXX_main            := main.cpp
-SRC_CXX_test            := test_dummy.cpp
+
+SUBDIRS                 := test
 
 include $(BUILDIR)/mk/dir.mk
@@ -2,11 +2,15 @@
 #ifndef _FILE_H_INCLUDED_
 #define _FILE_H_INCLUDED_
 
+#include <algorithm>
 #include <cstddef>
-#include <unordered_set>
 #include <utility>
+#include <vector>
+
+#include <sys/uio.h>
 
 #include "errors.h"
+#include "io_engine.h"
 
 namespace smux_client
 {
@@ -20,9 +24,55 @@ namespace smux_client
 
     /**
      * \brief                   type for sets of file descriptors
+     *
+     * Files use only a handful of file descriptors, so a flat vector is searched linearly
+     * instead of hashing.
      */
     template<class FD>
-    using basic_file_descriptor_set = std::unordered_set<FD>;
+    class basic_file_descriptor_set
+    {
+        public:
+            using value_type = FD;
+            using const_iterator = typename std::vector<FD>::const_iterator;
+
+            /// insert a file descriptor (no-op if already present)
+            void insert(FD const& fd)
+            {
+                if(!count(fd))
+                    _fds.push_back(fd);
+            }
+
+            /// remove a file descriptor
+            void erase(FD const& fd)
+            {
+                _fds.erase(std::remove(_fds.begin(), _fds.end(), fd), _fds.end());
+            }
+
+            /// 1 if fd is in the set, 0 otherwise
+            std::size_t count(FD const& fd) const
+            {
+                return std::find(_fds.begin(), _fds.end(), fd) != _fds.end() ? 1 : 0;
+            }
+
+            /// remove all file descriptors (keeps the memory)
+            void clear()
+            {
+                _fds.clear();
+            }
+
+            std::size_t size() const { return _fds.size(); }
+            bool empty() const { return _fds.empty(); }
+            const_iterator begin() const { return _fds.begin(); }
+            const_iterator end() const { return _fds.end(); }
+
+            void swap(basic_file_descriptor_set& other)
+            {
+                _fds.swap(other._fds);
+            }
+
+        private:
+            std::vector<FD> _fds;
+    };
     using file_descriptor_set = basic_file_descriptor_set<file_descriptor>;
 
     /**
@@ -33,6 +83,9 @@ namespace smux_client
      * Main purpose is abstraction of the select() and read()/write() interface. When select
      * signals any hooked up event, the appropriate handler is called, followed by, if required,
      * read() or write().
+     *
+     * If the runtime system runs RX and TX in separate threads, a file used for input and output
+     * is read by one thread and written by the other. select_fds() is called by both.
      */
     template<class FD, class FD_SET = basic_file_descriptor_set<FD>>
     class basic_file
@@ -104,6 +157,74 @@ namespace smux_client
              */
             virtual std::size_t write(const void* buf, std::size_t count) = 0;
 
+            /**
+             * \brief                   write several buffers to the file
+             * \param iov               buffers to write
+             * \param iovcnt            number of entries in iov
+             * \return                  actual number of written bytes
+             * \throw                   system_error
+             *
+             * The default implementation writes the first non-empty buffer only.
+             */
+            virtual std::size_t writev(const struct iovec* iov, int iovcnt)
+            {
+                for(int i = 0; i < iovcnt; ++i)
+                {
+                    if(iov[i].iov_len)
+                        return write(iov[i].iov_base, iov[i].iov_len);
+                }
+                return 0;
+            }
+
+            /**
+             * \brief                   switch the file descriptors to non-blocking mode
+             * \throw                   system_error
+             *
+             * Called by the runtime system before the file is monitored. Afterwards, read(),
+             * write() and writev() return 0 if they would block (eof() tells the difference
+             * for read()). The original mode is restored on destruction.
+             */
+            virtual void set_nonblocking()
+            {
+            }
+
+            /**
+             * \brief                   hand reads and writes to completion-based I/O engines
+             * \param reader            engine for read() (nullptr: read directly)
+             * \param writer            engine for write() and writev() (nullptr: write directly)
+             *
+             * Called by the runtime system before the file is monitored if its event backend
+             * performs I/O itself. Files that cannot use an engine ignore the call (default).
+             * With an engine, read(), write() and writev() work on the caller's buffers in the
+             * background: a call that returns 0 may have submitted a request, and the buffers
+             * must stay valid and unchanged until read_pending() or write_pending() returns
+             * false. The caller repeats the call with the same data once the file is ready.
+             */
+            virtual void set_io_engine(io_engine* reader, io_engine* writer)
+            {
+                (void)reader;
+                (void)writer;
+            }
+
+            /**
+             * \brief                   check if the buffer of an earlier read() is still in use
+             * \return                  true if an I/O engine reads into it (default: false)
+             */
+            virtual bool read_pending() const
+            {
+                return false;
+            }
+
+            /**
+             * \brief                   check if the data of an earlier write() or writev() is still
+             *                          in use
+             * \return                  true if an I/O engine writes it (default: false)
+             */
+            virtual bool write_pending() const
+            {
+                return false;
+            }
+
             /**
              * \brief                   file has reached eof
              * \return                  true if read part is at eof
@@ -2,6 +2,10 @@
 #include "file.h"
 #include "file_factory.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -10,6 +14,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <limits.h> // for PIPE_BUF
+#include <poll.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/socket.h>
@@ -68,13 +74,56 @@ namespace smux_client
                 (void)except_fds;
             }
 
+            virtual void set_nonblocking() override
+            {
+                _flags_r = _set_nonblocking(_fdr);
+                if(_fdw != _fdr)
+                    _flags_w = _set_nonblocking(_fdw);
+            }
+
+            virtual void set_io_engine(io_engine* reader, io_engine* writer) override
+            {
+                _reader = _fdr != fd_nil ? reader : nullptr;
+                _writer = _fdw != fd_nil ? writer : nullptr;
+                if(_reader)
+                    _reader->attach_read(_fdr);
+                if(_writer)
+                    _writer->attach_write(_fdw);
+            }
+
+            virtual bool read_pending() const override
+            {
+                return _reader && _reader->read_pending(_fdr);
+            }
+
+            virtual bool write_pending() const override
+            {
+                return _writer && _writer->write_pending(_fdw);
+            }
+
             virtual std::size_t read(void* buf, std::size_t count) override
             {
                 if(_fdr == fd_nil)
                     return 0;
-                auto ret = ::read(_fdr, buf, count);
+                if(_reader)
+                {
+                    bool eof = false;
+                    std::size_t ret = _reader->read_async(_fdr, buf, count, eof);
+                    if(eof)
+                        _eof = true;
+                    return ret;
+                }
+                ssize_t ret;
+                do
+                {
+                    ret = ::read(_fdr, buf, count);
+                } while(ret < 0 && errno == EINTR);
                 if(ret < 0)
+                {
+                    if(errno == EAGAIN || errno == EWOULDBLOCK)
+                        return 0; // no data yet, but no eof either
                     throw system_error(errno);
+                }
                 if(ret == 0) // eof -> avoid further read events
                 {
                     _eof = true;
@@ -87,9 +136,42 @@ namespace smux_client
             {
                 if(_fdw == fd_nil)
                     return 0;
-                auto ret = ::write(_fdw, buf, count);
+                if(_writer)
+                {
+                    struct iovec iov = {const_cast<void*>(buf), count};
+                    return _writer->writev_async(_fdw, &iov, 1);
+                }
+                ssize_t ret;
+                do
+                {
+                    ret = ::write(_fdw, buf, count);
+                } while(ret < 0 && errno == EINTR);
                 if(ret < 0)
+                {
+                    if(errno == EAGAIN || errno == EWOULDBLOCK)
+                        return 0;
                     throw system_error(errno);
+                }
+                return static_cast<std::size_t>(ret);
+            }
+
+            virtual std::size_t writev(const struct iovec* iov, int iovcnt) override
+            {
+                if(_fdw == fd_nil)
+                    return 0;
+                if(_writer)
+                    return _writer->writev_async(_fdw, iov, iovcnt);
+                ssize_t ret;
+                do
+                {
+                    ret = ::writev(_fdw, iov, iovcnt);
+                } while(ret < 0 && errno == EINTR);
+                if(ret < 0)
+                {
+                    if(errno == EAGAIN || errno == EWOULDBLOCK)
+                        return 0;
+                    throw system_error(errno);
+                }
                 return static_cast<std::size_t>(ret);
             }
 
@@ -100,6 +182,11 @@ namespace smux_client
 
             virtual ~simple_file()
             {
+                // restore the original mode (file descriptions may be shared, e.g. stdio)
+                if(_flags_r != -1)
+                    fcntl(_fdr, F_SETFL, _flags_r);
+                if(_flags_w != -1)
+                    fcntl(_fdw, F_SETFL, _flags_w);
                 if(_fdr != fd_nil)
                     close(_fdr);
                 if(_fdw != _fdr && _fdw != fd_nil)
@@ -108,7 +195,23 @@ namespace smux_client
             }
         protected:
             int _fdr, _fdw;
-            bool _eof;
+            std::atomic<bool> _eof; // set by read(), also checked by select_fds() of the writing thread
+            io_engine* _reader = nullptr; // completion-based I/O instead of syscalls
+            io_engine* _writer = nullptr;
+
+        private:
+            // set O_NONBLOCK on fd, return the previous flags (-1 if fd is nil)
+            static int _set_nonblocking(int fd)
+            {
+                if(fd == fd_nil)
+                    return -1;
+                int flags = fcntl(fd, F_GETFL);
+                if(flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+                    throw system_error(errno, std::string("setting non-blocking mode failed: ") + std::strerror(errno));
+                return flags;
+            }
+
+            int _flags_r = -1, _flags_w = -1; // original file status flags
     };
 
     // simple file for reading/writing
@@ -175,6 +278,78 @@ namespace smux_client
                         throw system_error(errno);
                 }
             }
+
+            virtual void set_nonblocking() override
+            {
+                // The file descriptions are shared with other processes (and on a terminal
+                // or with 2>&1 also with stderr, which std::clog writes to), so O_NONBLOCK
+                // must not be set on them. Instead, read and write only what poll() reports
+                // to be possible without blocking.
+                _poll_first = true;
+                _write_max = _is_regular(_fdw) ? SIZE_MAX : PIPE_BUF;
+            }
+
+            virtual std::size_t read(void* buf, std::size_t count) override
+            {
+                if(_poll_first && !_reader && !_ready(_fdr, POLLIN))
+                    return 0;
+                return simple_file::read(buf, count);
+            }
+
+            virtual std::size_t write(const void* buf, std::size_t count) override
+            {
+                if(_poll_first && !_writer)
+                {
+                    if(!_ready(_fdw, POLLOUT))
+                        return 0;
+                    count = std::min(count, _write_max);
+                }
+                return simple_file::write(buf, count);
+            }
+
+            virtual std::size_t writev(const struct iovec* iov, int iovcnt) override
+            {
+                if(_poll_first && !_writer)
+                {
+                    if(iovcnt <= 0 || !_ready(_fdw, POLLOUT))
+                        return 0;
+                    if(iov[0].iov_len >= _write_max)
+                        return simple_file::write(iov[0].iov_base, _write_max);
+                    // only whole buffers up to _write_max
+                    std::size_t total = iov[0].iov_len;
+                    int n = 1;
+                    while(n < iovcnt && total + iov[n].iov_len <= _write_max)
+                        total += iov[n++].iov_len;
+                    iovcnt = n;
+                }
+                return simple_file::writev(iov, iovcnt);
+            }
+
+        private:
+            // true if fd is ready for events (or has an error/hangup to report)
+            static bool _ready(int fd, short events)
+            {
+                if(fd == fd_nil)
+                    return true;
+                struct pollfd pfd = {fd, events, 0};
+                int ret;
+                do
+                {
+                    ret = poll(&pfd, 1, 0);
+                } while(ret < 0 && errno == EINTR);
+                if(ret < 0)
+                    throw system_error(errno);
+                return ret > 0;
+            }
+
+            static bool _is_regular(int fd)
+            {
+                struct stat st;
+                return fd != fd_nil && fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+            }
+
+            bool _poll_first = false; // emulate non-blocking mode with poll()
+            std::size_t _write_max = SIZE_MAX; // maximum size of a write that cannot block
     };
 
     /**
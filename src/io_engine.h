@@ -0,0 +1,90 @@
+/// \file io_engine.h
+#ifndef _IO_ENGINE_H_INCLUDED_
+#define _IO_ENGINE_H_INCLUDED_
+
+#include <cstddef>
+
+#include <sys/uio.h>
+
+namespace smux_client
+{
+    /**
+     * \brief                   completion-based I/O on behalf of files
+     *
+     * Offered by event backends that perform reads and writes themselves (io_uring). A file
+     * attached to an engine hands its read(), write() and writev() calls to the engine instead
+     * of issuing syscalls. The engine works on the caller's buffers: a call finding no request
+     * in flight submits one on the given buffers and returns 0, like a non-blocking syscall
+     * that would block. The buffers then belong to the engine until the result is reported:
+     * the caller repeats the call with the same buffers once the fd is reported ready, which
+     * returns the result of the completed request. The fd is reported ready while it has no
+     * request in flight, so that the caller submits one.
+     *
+     * An engine belongs to one event loop and must only be used by its thread.
+     */
+    class io_engine
+    {
+        public:
+            /**
+             * \brief                   perform reads on fd through this engine
+             */
+            virtual void attach_read(int fd) = 0;
+
+            /**
+             * \brief                   perform writes on fd through this engine
+             */
+            virtual void attach_write(int fd) = 0;
+
+            /**
+             * \brief                   read from fd into the caller's buffer
+             * \param fd                file descriptor attached with attach_read()
+             * \param buf               buffer, must stay valid and unused until the result is
+             *                          reported
+             * \param count             capacity of buf
+             * \param[out] eof          set to true at the end of the file
+             * \return                  number of bytes read into buf by the completed request
+             *                          (0 if it is still in flight or has just been submitted)
+             * \throw                   system_error if the read failed
+             *
+             * If the caller had to move the unused buffer in the meantime, buf may differ from
+             * the buffer of the request (which must still be valid). The data is then copied
+             * to buf, which must be at least as large.
+             */
+            virtual std::size_t read_async(int fd, void* buf, std::size_t count, bool& eof) = 0;
+
+            /**
+             * \brief                   write the caller's buffers to fd
+             * \param fd                file descriptor attached with attach_write()
+             * \param iov               buffers, the data must stay unchanged at their beginning
+             *                          until the result is reported
+             * \param iovcnt            number of buffers
+             * \return                  number of bytes from the beginning of iov written by the
+             *                          completed request (0 if it is still in flight or has just
+             *                          been submitted)
+             * \throw                   system_error if the write failed
+             */
+            virtual std::size_t writev_async(int fd, const struct iovec* iov, int iovcnt) = 0;
+
+            /**
+             * \brief                   check if the engine uses the caller's read buffer
+             * \param fd                file descriptor attached with attach_read()
+             * \return                  true while a read is in flight or its result is not
+             *                          reported yet
+             */
+            virtual bool read_pending(int fd) const = 0;
+
+            /**
+             * \brief                   check if the engine uses the caller's write buffers
+             * \param fd                file descriptor attached with attach_write()
+             * \return                  true while a write is in flight or its result is not
+             *                          reported yet
+             */
+            virtual bool write_pending(int fd) const = 0;
+
+        protected:
+            ~io_engine() = default;
+    };
+
+} // namespace smux_client
+
+#endif // ifndef _IO_ENGINE_H_INCLUDED_
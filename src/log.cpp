@@ -0,0 +1,134 @@
+// log.cpp
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "log.h"
+
+using namespace smux_client;
+
+logger& logger::get()
+{
+    static logger instance;
+    return instance;
+}
+
+logger::logger()
+    : _level(static_cast<int>(log_level::info))
+{
+    for(std::size_t i = 0; i < RING_SIZE; ++i)
+        _slots[i].seq.store(i, std::memory_order_relaxed);
+
+    // a busy channel produces data traces on every event
+    set_rate_limit(log_category::data, 1000);
+}
+
+void logger::post(log_level level, log_category cat, const char* text, std::size_t len)
+{
+    if(!_admit(cat))
+        return;
+
+    // claim a slot
+    std::size_t pos = _head.load(std::memory_order_relaxed);
+    slot* s;
+    while(true)
+    {
+        s = &_slots[pos & (RING_SIZE - 1)];
+        std::size_t seq = s->seq.load(std::memory_order_acquire);
+        if(seq == pos)
+        {
+            if(_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if(seq < pos + 1)
+        {
+            // still filled from the previous round: ring is full
+            _overflows.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else
+            pos = _head.load(std::memory_order_relaxed);
+    }
+
+    // fill and publish it
+    s->level = level;
+    s->cat = cat;
+    s->len = std::min<std::size_t>(len, MESSAGE_SIZE);
+    std::memcpy(s->text, text, s->len);
+    s->seq.store(pos + 1, std::memory_order_release);
+}
+
+void logger::drain(std::ostream& os)
+{
+    if(_draining.test_and_set(std::memory_order_acquire))
+        return; // another thread is draining
+
+    bool written = false;
+    while(true)
+    {
+        slot& s = _slots[_tail & (RING_SIZE - 1)];
+        if(s.seq.load(std::memory_order_acquire) != _tail + 1)
+            break; // empty (or not yet published)
+        os.write(s.text, s.len);
+        s.seq.store(_tail + RING_SIZE, std::memory_order_release);
+        ++_tail;
+        written = true;
+    }
+
+    // report what has been dropped since the last drain
+    for(int cat = 0; cat < static_cast<int>(log_category::count_); ++cat)
+    {
+        std::uint64_t n = _rates[cat].suppressed.exchange(0, std::memory_order_relaxed);
+        if(n)
+        {
+            os << "\n[log] " << n << ' ' << log_category_name(static_cast<log_category>(cat))
+                << " messages suppressed (rate limit)\n";
+            written = true;
+        }
+    }
+    std::uint64_t n = _overflows.exchange(0, std::memory_order_relaxed);
+    if(n)
+    {
+        os << "\n[log] " << n << " messages lost (ring full)\n";
+        written = true;
+    }
+    if(written)
+        os.flush();
+
+    _draining.clear(std::memory_order_release);
+}
+
+bool logger::_admit(log_category cat)
+{
+    rate& r = _rates[static_cast<int>(cat)];
+    unsigned limit = r.limit.load(std::memory_order_relaxed);
+    if(!limit)
+        return true;
+
+    // fixed one second windows, the first message of a new window resets the count
+    std::uint64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    std::uint64_t window = r.window.load(std::memory_order_relaxed);
+    if(window != now && r.window.compare_exchange_strong(window, now, std::memory_order_relaxed))
+        r.count.store(0, std::memory_order_relaxed);
+    if(r.count.fetch_add(1, std::memory_order_relaxed) < limit)
+        return true;
+    r.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+char const* smux_client::log_category_name(log_category cat)
+{
+    switch(cat)
+    {
+        case log_category::general:
+            return "general";
+        case log_category::master:
+            return "master";
+        case log_category::channel:
+            return "channel";
+        case log_category::data:
+            return "data";
+        case log_category::count_:
+            break;
+    }
+    return "unknown";
+}
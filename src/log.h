@@ -0,0 +1,194 @@
+/// \file log.h
+#ifndef _LOG_H_INCLUDED_
+#define _LOG_H_INCLUDED_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+namespace smux_client
+{
+    /**
+     * \brief                   severity of a log message
+     */
+    enum class log_level
+    {
+        error,
+        warning,
+        info,
+        debug,
+        trace, ///< per-event data path tracing
+    };
+
+    /**
+     * \brief                   origin of a log message, each category has its own rate limit
+     */
+    enum class log_category
+    {
+        general,
+        master, ///< master file events
+        channel, ///< channel file events
+        data, ///< data path tracing ('<ch' read, '>ch' written)
+        count_ ///< number of categories
+    };
+
+    /**
+     * \brief                   asynchronous logger
+     *
+     * Messages are formatted by the caller and copied into a lock-free ring of fixed-size
+     * slots (multiple producers, single consumer). Posting never blocks: messages are dropped
+     * if the ring is full or the rate limit of their category is exceeded. The ring is drained
+     * by drain(), which the runtime system calls whenever it goes idle. Dropped messages are
+     * counted and reported with the next drain.
+     */
+    class logger
+    {
+        public:
+            enum
+            {
+                RING_SIZE = 1024, ///< number of slots (power of 2)
+                MESSAGE_SIZE = 240, ///< maximum length of a message, longer ones are truncated
+            };
+
+            /**
+             * \brief                   get the process-wide logger
+             */
+            static logger& get();
+
+            /**
+             * \brief                   set the maximum level of messages to post
+             * \param level             level (default: info)
+             *
+             * May be called at any time, e.g. from a signal handler.
+             */
+            void set_level(log_level level)
+            {
+                _level.store(static_cast<int>(level), std::memory_order_relaxed);
+            }
+
+            /// current maximum level
+            log_level level() const
+            {
+                return static_cast<log_level>(_level.load(std::memory_order_relaxed));
+            }
+
+            /**
+             * \brief                   check if a message would be posted
+             *
+             * Call sites on the data path check this before formatting.
+             */
+            bool enabled(log_level level) const
+            {
+                return static_cast<int>(level) <= _level.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * \brief                   limit the number of messages of a category
+             * \param cat               category
+             * \param per_second        maximum number of messages per second (0 = unlimited)
+             */
+            void set_rate_limit(log_category cat, unsigned per_second)
+            {
+                _rates[static_cast<int>(cat)].limit.store(per_second, std::memory_order_relaxed);
+            }
+
+            /**
+             * \brief                   post a message
+             * \param level             level
+             * \param cat               category
+             * \param text              message (written as is, include a newline if needed)
+             * \param len               length of text
+             *
+             * Lock-free and safe to call from several threads.
+             */
+            void post(log_level level, log_category cat, const char* text, std::size_t len);
+
+            /**
+             * \brief                   write all posted messages
+             * \param os                stream to write to (flushed once at the end)
+             *
+             * Only one thread drains at a time, concurrent calls return immediately.
+             */
+            void drain(std::ostream& os);
+
+        private:
+            logger();
+
+            // sorry, no copy
+            logger(logger const&) = delete;
+            logger& operator=(logger const&) = delete;
+
+            struct slot
+            {
+                std::atomic<std::size_t> seq; // == position: free, == position + 1: filled
+                log_level level;
+                log_category cat;
+                std::size_t len;
+                char text[MESSAGE_SIZE];
+            };
+
+            struct rate
+            {
+                std::atomic<unsigned> limit{0};
+                std::atomic<std::uint64_t> window{0}; // second of the current count
+                std::atomic<unsigned> count{0};
+                std::atomic<std::uint64_t> suppressed{0};
+            };
+
+            // true if the rate limit of cat allows another message
+            bool _admit(log_category cat);
+
+            std::atomic<int> _level;
+            slot _slots[RING_SIZE];
+            std::atomic<std::size_t> _head{0}; // next position to post to
+            std::size_t _tail = 0; // next position to drain (consumer only)
+            std::atomic_flag _draining = ATOMIC_FLAG_INIT;
+            std::atomic<std::uint64_t> _overflows{0}; // messages dropped because the ring was full
+            rate _rates[static_cast<int>(log_category::count_)];
+    };
+
+    /**
+     * \brief                   get the name of a log category
+     */
+    char const* log_category_name(log_category cat);
+
+    namespace detail
+    {
+        inline void log_append(std::ostream&)
+        {
+        }
+
+        template<class T, class... Args>
+        void log_append(std::ostream& os, T const& value, Args const&... args)
+        {
+            os << value;
+            log_append(os, args...);
+        }
+    } // namespace detail
+
+    /**
+     * \brief                   format and post a log message if its level is enabled
+     * \param level             level
+     * \param cat               category
+     * \param args              values to write to the message using operator<<
+     *
+     * Example: log(log_level::info, log_category::channel, "eof on channel ", ch, '\n');
+     */
+    template<class... Args>
+    void log(log_level level, log_category cat, Args const&... args)
+    {
+        logger& l = logger::get();
+        if(!l.enabled(level))
+            return;
+        std::ostringstream os;
+        detail::log_append(os, args...);
+        std::string const text = os.str();
+        l.post(level, cat, text.data(), text.size());
+    }
+
+} // namespace smux_client
+
+#endif // ifndef _LOG_H_INCLUDED_
@@ -14,6 +14,7 @@
 #include "rt.h"
 #include "cnf_argv.h"
 #include "debug.h"
+#include "log.h"
 
 /**
  * \brief                   create and configure the runtime system
@@ -33,6 +34,15 @@ static void signal_handler(int, siginfo_t *, void *)
     if(rt)
         rt->shutdown();
 }
+static void trace_signal_handler(int)
+{
+    // toggle data path tracing (setting the level is a relaxed atomic store)
+    using namespace smux_client;
+    static log_level previous = log_level::trace;
+    log_level current = logger::get().level();
+    logger::get().set_level(previous);
+    previous = current;
+}
 static void setup_signals()
 {
     // catch signals to allow clean shutdown
@@ -44,6 +54,12 @@ static void setup_signals()
             sigaction(SIGPIPE, &sa, 0) || sigaction(SIGHUP, &sa, 0))
         std::cerr << "registering signal handler failed: " << std::strerror(errno) << std::endl;
 
+    // SIGUSR1 toggles tracing
+    sa.sa_handler = trace_signal_handler;
+    sa.sa_flags = SA_RESTART;
+    if(sigaction(SIGUSR1, &sa, 0))
+        std::cerr << "registering signal handler failed: " << std::strerror(errno) << std::endl;
+
     // ignore SIGCHLD and clean up children automatically
     sa.sa_handler = SIG_DFL;
     sa.sa_flags = SA_NOCLDWAIT;
@@ -80,6 +96,12 @@ int main(int argc, char* argv[])
     }
     print_config(std::clog, *conf);
 
+    // -d enables debug messages, -dd also traces the data path
+    if(conf->debug_level() >= 2)
+        logger::get().set_level(log_level::trace);
+    else if(conf->debug_level() == 1)
+        logger::get().set_level(log_level::debug);
+
     // create/configure the runtime system
     try
     {
@@ -100,8 +122,14 @@ int main(int argc, char* argv[])
         rt->run();
     } catch(system_error& e)
     {
+        logger::get().drain(std::clog);
         std::cerr << "main loop exited: " << e.what() << std::endl;
     }
+    logger::get().drain(std::clog);
+    print_budget_counters(std::clog, rt->budget_stats());
+    std::clog << std::endl;
+    print_pool_counters(std::clog, block_pool::get().stats());
+    std::clog << std::endl;
 
     return 0;
 }
@@ -138,6 +166,18 @@ static std::unique_ptr<smux_client::runtime_system> load_rt(smux_client::cnf con
             throw config_error("master file definition required");
     }
 
+    rt->set_poller_type(conf.backend());
+    rt->set_budget(conf.budget());
+    rt->set_split(conf.split_threads());
+    std::size_t read_size = runtime_system::RECEIVE_BUFFER_SIZE;
+    std::size_t smux_size = runtime_system::SMUX_BUFFER_SIZE;
+    if(conf.read_size())
+        read_size = conf.read_size();
+    if(conf.smux_buffer_size())
+        smux_size = conf.smux_buffer_size();
+    rt->set_buffer_sizes(read_size, smux_size);
+    rt->set_adaptive(conf.adaptive_buffers());
+
     // create/add all files
     for(auto const& fl_def : conf.channels())
     {
@@ -176,12 +216,26 @@ void print_help(std::ostream& os, char const* pgrm_name)
         << "It was influenced by, and could be seen as an extension to the great socat(1)\n"
         << "tool, with which it tightly integrates to allow greatest possible flexibility.\n"
         << "\nUsage:\n"
-        << "(1) " << pgrm_name << " -m <file definition> {-c <channel definition>}\n"
+        << "(1) " << pgrm_name << " [-d] [-t] [-a] [-r <size>] [-s <size>] [-b <backend>] [-q <size>] [-Q <size>] [-o <policy>] -m <file definition> {-c <channel definition>}\n"
         << "(2) " << pgrm_name << " -h\n\n"
         << "Options:\n"
         << " -h         Print this help message and exit\n"
+        << " -d         Print debug messages, twice to trace each transfer ('<ch' read\n"
+        << "            from, '>ch' written to channel ch); SIGUSR1 toggles tracing\n"
         << " -m <fd>    Specify the master file definition\n"
         << " -c <cd>    Add a channel definition\n"
+        << " -t         Run the TX path (channels -> master) in a separate thread\n"
+        << " -r <size>  Number of bytes read from a file at once (default: 2048)\n"
+        << " -s <size>  Size of the smux read and write buffers (default: 4096)\n"
+        << " -a         Adapt read sizes and smux buffers to the traffic, starting with\n"
+        << "            the sizes above\n"
+        << " -b <name>  Event backend: 'epoll' (default), 'select' or 'uring'\n"
+        << " -q <size>  Limit of pending output per channel (default: unlimited)\n"
+        << " -Q <size>  Limit of pending output of all channels (default: unlimited)\n"
+        << " -o <name>  Action when a limit is reached: 'block' (default) stops reading\n"
+        << "            the master, 'drop' discards the oldest pending data of the\n"
+        << "            channel, 'spill' moves further data to a temporary file\n"
+        << "  Sizes are given in bytes, optionally followed by k, M or G.\n"
         << "\n"
         << "File definition:\n"
         << "(1) <file type>[:<argument>]\n"
@@ -0,0 +1,843 @@
+// poller.cpp
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/syscall.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#include "poller.h"
+
+namespace smux_client
+{
+    // select() based poller, works everywhere but is limited to FD_SETSIZE
+    class select_poller : public poller
+    {
+        public:
+            select_poller()
+                : _data(FD_SETSIZE, nullptr)
+            {
+                FD_ZERO(&_read);
+                FD_ZERO(&_write);
+                FD_ZERO(&_except);
+            }
+
+            virtual void set(file_descriptor fd, unsigned events, void* data) override
+            {
+                if(fd < 0 || fd >= FD_SETSIZE)
+                    throw system_error(EINVAL, "file descriptor exceeds FD_SETSIZE, use epoll");
+
+                FD_CLR(fd, &_read);
+                FD_CLR(fd, &_write);
+                FD_CLR(fd, &_except);
+                if(events == none)
+                {
+                    _data[fd] = nullptr;
+                    return;
+                }
+                if(events & read)
+                    FD_SET(fd, &_read);
+                if(events & write)
+                    FD_SET(fd, &_write);
+                if(events & except)
+                    FD_SET(fd, &_except);
+                _data[fd] = data;
+                _fd_max = std::max(_fd_max, fd);
+            }
+
+            virtual void wait(std::vector<event>& events) override
+            {
+                events.clear();
+
+                fd_set rd = _read, wr = _write, ex = _except;
+                int nfds = _fd_max + 1;
+                int ret = select(nfds, &rd, &wr, &ex, nullptr);
+                if(ret < 0)
+                {
+                    if(errno == EINTR) // tolerate interrupted syscall
+                        return;
+                    throw system_error(errno);
+                }
+
+                for(file_descriptor fd = 0; fd < nfds && ret > 0; ++fd)
+                {
+                    unsigned ev = (FD_ISSET(fd, &rd) ? read : none) | (FD_ISSET(fd, &wr) ? write : none)
+                        | (FD_ISSET(fd, &ex) ? except : none);
+                    if(ev == none)
+                        continue;
+                    --ret;
+                    events.push_back(event{fd, ev, _data[fd]});
+                }
+            }
+
+            virtual poller_type type() const override
+            {
+                return poller_type::select;
+            }
+
+        private:
+            fd_set _read, _write, _except;
+            file_descriptor _fd_max = 0;
+            std::vector<void*> _data; // indexed by fd
+    };
+
+    // epoll based poller, registers each fd once
+    class epoll_poller : public poller
+    {
+        public:
+            epoll_poller()
+                : _epfd(epoll_create1(EPOLL_CLOEXEC))
+            {
+                if(_epfd < 0)
+                    throw system_error(errno);
+            }
+
+            virtual void set(file_descriptor fd, unsigned events, void* data) override
+            {
+                if(fd < 0)
+                    throw system_error(EBADF);
+                if(static_cast<size_t>(fd) >= _regs.size())
+                    _regs.resize(fd + 1);
+                auto& reg = _regs[fd];
+
+                // nothing changed -> avoid the syscall
+                if(reg.events == events && reg.data == data)
+                    return;
+
+                if(events == none)
+                {
+                    if(reg.always_ready)
+                        _always_ready.erase(std::find(_always_ready.begin(), _always_ready.end(), fd));
+                    else
+                        epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, nullptr);
+                    reg = registration();
+                    return;
+                }
+
+                if(!reg.always_ready)
+                {
+                    struct epoll_event ev = {};
+                    ev.events = (events & read ? uint32_t(EPOLLIN) : 0) | (events & write ? uint32_t(EPOLLOUT) : 0)
+                        | (events & except ? uint32_t(EPOLLPRI) : 0);
+                    ev.data.u64 = static_cast<uint64_t>(fd);
+                    int op = reg.events == none ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+                    if(epoll_ctl(_epfd, op, fd, &ev) < 0)
+                    {
+                        if(errno != EPERM)
+                            throw system_error(errno);
+                        // regular files cannot be polled, but never block (like with select())
+                        reg.always_ready = true;
+                        _always_ready.push_back(fd);
+                    }
+                }
+                reg.events = events;
+                reg.data = data;
+            }
+
+            virtual void wait(std::vector<event>& events) override
+            {
+                events.clear();
+
+                struct epoll_event ready[64];
+                int timeout = _always_ready.empty() ? -1 : 0;
+                int ret = epoll_wait(_epfd, ready, sizeof(ready) / sizeof(ready[0]), timeout);
+                if(ret < 0)
+                {
+                    if(errno == EINTR) // tolerate interrupted syscall
+                        return;
+                    throw system_error(errno);
+                }
+
+                for(int i = 0; i < ret; ++i)
+                {
+                    file_descriptor fd = static_cast<file_descriptor>(ready[i].data.u64);
+                    auto const& reg = _regs[fd];
+                    uint32_t e = ready[i].events;
+                    // report hangup and errors as readiness, read()/write() will tell the details
+                    unsigned ev = ((e & (EPOLLIN | EPOLLHUP | EPOLLERR)) && (reg.events & read) ? read : none)
+                        | ((e & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && (reg.events & write) ? write : none)
+                        | ((e & EPOLLPRI) ? except : none);
+                    if(ev != none)
+                        events.push_back(event{fd, ev, reg.data});
+                }
+                for(auto fd : _always_ready)
+                {
+                    auto const& reg = _regs[fd];
+                    if(reg.events & (read | write))
+                        events.push_back(event{fd, reg.events & (read | write), reg.data});
+                }
+            }
+
+            virtual poller_type type() const override
+            {
+                return poller_type::epoll;
+            }
+
+            virtual ~epoll_poller()
+            {
+                close(_epfd);
+            }
+
+        private:
+            // registration of a single file descriptor
+            struct registration
+            {
+                unsigned events = none;
+                void* data = nullptr;
+                bool always_ready = false; // not pollable (regular file)
+            };
+
+            int _epfd;
+            std::vector<registration> _regs; // indexed by fd
+            std::vector<file_descriptor> _always_ready; // registered fds not known to epoll
+    };
+
+#ifdef HAVE_IO_URING
+    /*
+     * io_uring based poller and I/O engine
+     *
+     * Files attached to the engine (io_engine) are read and written with IORING_OP_READ,
+     * IORING_OP_WRITE and IORING_OP_WRITEV directly on the buffers they are given (the smux
+     * rings for the master, the channel queues and read buffers of the runtime), so the data
+     * is copied exactly as often as with readiness-based I/O, minus the syscalls. At most one
+     * read and one write per fd are in flight. An attached fd is reported ready while it has
+     * no request in flight (so that its file submits one) or a completed request to report.
+     * All other fds have a one-shot IORING_OP_POLL_ADD in flight. One-shot polls are armed
+     * level-triggered, which the files rely on (they may leave data unread); multishot polls
+     * would be edge-triggered.
+     *
+     * New requests, registration changes and re-arming after an event are only queued as SQEs
+     * and submitted together with the wait in a single io_uring_enter(), so a loop iteration
+     * costs one syscall regardless of the number of reads, writes and changed registrations
+     * (none if attached fds are ready and nothing is queued). Requests on non-blocking fds that
+     * cannot wait for data themselves fail with EAGAIN and are resubmitted behind a linked poll.
+     */
+    class uring_poller : public poller, public io_engine
+    {
+        public:
+            uring_poller()
+            {
+                struct io_uring_params p = {};
+                _ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &p));
+                if(_ring_fd < 0)
+                    throw system_error(errno);
+
+                // reads and writes at the current file position
+                if(!(p.features & IORING_FEAT_RW_CUR_POS))
+                {
+                    close(_ring_fd);
+                    throw system_error(ENOSYS);
+                }
+
+                // map the rings
+                _sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(__u32);
+                _cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+                if(p.features & IORING_FEAT_SINGLE_MMAP)
+                    _sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+                _sq_ring = mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        _ring_fd, IORING_OFF_SQ_RING);
+                if(_sq_ring == MAP_FAILED)
+                {
+                    int err = errno;
+                    close(_ring_fd);
+                    throw system_error(err);
+                }
+                if(p.features & IORING_FEAT_SINGLE_MMAP)
+                    _cq_ring = _sq_ring;
+                else
+                {
+                    _cq_ring = mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            _ring_fd, IORING_OFF_CQ_RING);
+                    if(_cq_ring == MAP_FAILED)
+                    {
+                        int err = errno;
+                        munmap(_sq_ring, _sq_ring_size);
+                        close(_ring_fd);
+                        throw system_error(err);
+                    }
+                }
+                _sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+                void* sqes = mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        _ring_fd, IORING_OFF_SQES);
+                if(sqes == MAP_FAILED)
+                {
+                    int err = errno;
+                    _unmap();
+                    close(_ring_fd);
+                    throw system_error(err);
+                }
+                _sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+                char* sq = static_cast<char*>(_sq_ring);
+                _sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+                _sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+                _sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+                _sq_entries = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_entries);
+                _sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+                char* cq = static_cast<char*>(_cq_ring);
+                _cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+                _cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+                _cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+                _cqes = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+            }
+
+            virtual void set(file_descriptor fd, unsigned events, void* data) override
+            {
+                auto& reg = _reg(fd);
+
+                reg.data = data;
+                if(reg.events == events)
+                    return;
+                unsigned old_poll = _poll_events(reg);
+                reg.events = events;
+
+                if(_poll_events(reg) == old_poll)
+                    return;
+
+                // cancel the old poll, its completion is recognized by the outdated generation
+                if(reg.armed)
+                {
+                    auto* sqe = _get_sqe();
+                    sqe->opcode = IORING_OP_POLL_REMOVE;
+                    sqe->fd = -1;
+                    sqe->addr = _user_data(POLL, fd, reg.gen);
+                    sqe->user_data = REMOVE_USER_DATA;
+                    reg.armed = false;
+                }
+                ++reg.gen;
+                if(_poll_events(reg) != none)
+                    _arm(fd, reg);
+            }
+
+            virtual void wait(std::vector<event>& events) override
+            {
+                events.clear();
+
+                // re-arm the polls of the last events (still registered)
+                for(auto fd : _rearm)
+                {
+                    auto& reg = _regs[fd];
+                    if(_poll_events(reg) != none && !reg.armed)
+                        _arm(fd, reg);
+                }
+                _rearm.clear();
+
+                // submit all queued requests, wait for at least one completion unless an
+                // attached fd is ready already
+                bool ready = _async_ready();
+                if(!ready || _pending)
+                {
+                    if(_enter(_pending, ready ? 0 : 1, ready ? 0 : IORING_ENTER_GETEVENTS) < 0)
+                    {
+                        if(errno == EINTR) // tolerate interrupted syscall
+                            return;
+                        throw system_error(errno);
+                    }
+                }
+
+                _reap(&events);
+
+                // attached fds are ready according to their buffers
+                for(auto fd : _attached)
+                {
+                    auto& reg = _regs[fd];
+                    unsigned ev = _async_events(reg);
+                    if(ev != none)
+                        events.push_back(event{fd, ev, reg.data});
+                }
+            }
+
+            virtual poller_type type() const override
+            {
+                return poller_type::uring;
+            }
+
+            virtual io_engine* engine() override
+            {
+                return this;
+            }
+
+            virtual void attach_read(int fd) override
+            {
+                _attach(fd, read);
+            }
+
+            virtual void attach_write(int fd) override
+            {
+                _attach(fd, write);
+            }
+
+            virtual std::size_t read_async(int fd, void* buf, std::size_t count, bool& eof) override
+            {
+                auto& io = *_regs[fd].io;
+                if(io.rdone)
+                {
+                    io.rdone = false;
+                    if(io.rres < 0)
+                        throw system_error(-io.rres);
+                    if(io.rres == 0)
+                    {
+                        io.reof = true;
+                        eof = true;
+                        return 0;
+                    }
+                    // the caller has moved its data, the old buffer is still valid
+                    std::size_t n = static_cast<std::size_t>(io.rres);
+                    if(buf != io.rbuf)
+                        std::memmove(buf, io.rbuf, n);
+                    return n;
+                }
+                eof = io.reof;
+                if(!io.rposted && !io.reof && count && !_closing)
+                {
+                    io.rbuf = buf;
+                    io.rlen = count;
+                    _submit_read(fd, io);
+                }
+                return 0;
+            }
+
+            virtual std::size_t writev_async(int fd, const struct iovec* iov, int iovcnt) override
+            {
+                auto& io = *_regs[fd].io;
+                if(io.wdone)
+                {
+                    io.wdone = false;
+                    if(io.wres < 0)
+                        throw system_error(-io.wres);
+                    return static_cast<std::size_t>(io.wres);
+                }
+                if(!io.wposted && iovcnt > 0 && !_closing)
+                {
+                    // the kernel may read the vector after this call returns
+                    io.wiov.assign(iov, iov + std::min(iovcnt, IOV_MAX));
+                    _submit_write(fd, io);
+                }
+                return 0;
+            }
+
+            virtual bool read_pending(int fd) const override
+            {
+                auto const& io = *_regs[fd].io;
+                return io.rposted || io.rdone;
+            }
+
+            virtual bool write_pending(int fd) const override
+            {
+                auto const& io = *_regs[fd].io;
+                return io.wposted || io.wdone;
+            }
+
+            virtual ~uring_poller()
+            {
+                // the kernel must not touch the buffers of the files anymore: cancel and reap
+                // all reads and writes
+                _closing = true;
+                for(auto fd : _attached)
+                {
+                    auto& io = *_regs[fd].io;
+                    if(io.rposted)
+                    {
+                        _cancel(_user_data(INTERNAL, fd, READ));
+                        _cancel(_user_data(READ, fd, 0));
+                    }
+                    if(io.wposted)
+                    {
+                        _cancel(_user_data(INTERNAL, fd, WRITE));
+                        _cancel(_user_data(WRITE, fd, 0));
+                    }
+                }
+                while(_in_flight())
+                {
+                    if(_enter(_pending, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                        break;
+                    _reap(nullptr);
+                }
+
+                munmap(_sqes, _sqes_size);
+                _unmap();
+                close(_ring_fd);
+            }
+
+        private:
+            enum : unsigned
+            {
+                RING_ENTRIES = 256,
+                GEN_MASK = 0x3FFFFFFF,
+            };
+            // kinds of requests, stored in the top bits of the user data
+            enum : unsigned
+            {
+                POLL = 0,
+                READ = 1,
+                WRITE = 2,
+                INTERNAL = 3, // completion ignored (poll removal, cancellation, linked polls)
+            };
+            static constexpr __u64 REMOVE_USER_DATA = ~__u64(0);
+
+            // requests of an attached fd on the buffers of its file
+            struct async_io
+            {
+                // read into rbuf[0, rlen), result rres (bytes, 0 at eof or -errno)
+                void* rbuf = nullptr;
+                std::size_t rlen = 0;
+                int rres = 0;
+                bool rposted = false; // read in flight
+                bool rdone = false; // result not reported yet
+                bool reof = false;
+                // write of wiov, result wres (bytes or -errno)
+                std::vector<struct iovec> wiov;
+                int wres = 0;
+                bool wposted = false; // write in flight
+                bool wdone = false; // result not reported yet
+            };
+
+            // registration of a single file descriptor
+            struct registration
+            {
+                unsigned events = none;
+                void* data = nullptr;
+                unsigned gen = 0; // generation, identifies the current poll request
+                bool armed = false; // poll request in flight
+                unsigned async = none; // directions handled by the engine
+                std::unique_ptr<async_io> io;
+            };
+
+            // process completions, poll events are added to events (if given)
+            void _reap(std::vector<event>* events)
+            {
+                unsigned head = *_cq_head;
+                unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+                for(; head != tail; ++head)
+                {
+                    auto const& cqe = _cqes[head & _cq_mask];
+                    unsigned kind = static_cast<unsigned>(cqe.user_data >> 62);
+                    file_descriptor fd = static_cast<file_descriptor>(cqe.user_data & 0xFFFFFFFF);
+                    if(kind == INTERNAL || static_cast<size_t>(fd) >= _regs.size())
+                        continue;
+                    auto& reg = _regs[fd];
+                    if(kind == READ)
+                    {
+                        _read_done(fd, *reg.io, cqe.res);
+                        continue;
+                    }
+                    if(kind == WRITE)
+                    {
+                        _write_done(fd, *reg.io, cqe.res);
+                        continue;
+                    }
+
+                    unsigned gen = static_cast<unsigned>(cqe.user_data >> 32) & GEN_MASK;
+                    if(reg.gen != gen) // completion of a replaced registration
+                        continue;
+                    reg.armed = false;
+                    _rearm.push_back(fd);
+
+                    // report errors as readiness, read()/write() will tell the details
+                    unsigned poll_events = _poll_events(reg);
+                    unsigned mask = cqe.res < 0 ? POLLERR : static_cast<unsigned>(cqe.res);
+                    unsigned ev = ((mask & (POLLIN | POLLHUP | POLLERR)) && (poll_events & read) ? read : none)
+                        | ((mask & (POLLOUT | POLLHUP | POLLERR)) && (poll_events & write) ? write : none)
+                        | ((mask & POLLPRI) && (poll_events & except) ? except : none);
+                    if(ev != none && events)
+                        events->push_back(event{fd, ev, reg.data});
+                }
+                __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+            }
+
+            // reads or writes in flight
+            bool _in_flight() const
+            {
+                for(auto fd : _attached)
+                {
+                    auto const& io = *_regs[fd].io;
+                    if(io.rposted || io.wposted)
+                        return true;
+                }
+                return false;
+            }
+
+            static __u64 _user_data(unsigned kind, file_descriptor fd, unsigned gen)
+            {
+                return (static_cast<__u64>(kind) << 62) | (static_cast<__u64>(gen & GEN_MASK) << 32)
+                    | static_cast<__u32>(fd);
+            }
+
+            registration& _reg(file_descriptor fd)
+            {
+                if(fd < 0)
+                    throw system_error(EBADF);
+                if(static_cast<size_t>(fd) >= _regs.size())
+                    _regs.resize(fd + 1);
+                return _regs[fd];
+            }
+
+            // events monitored with poll requests
+            static unsigned _poll_events(registration const& reg)
+            {
+                return reg.events & ~reg.async;
+            }
+
+            // events of an attached fd: ready to submit a request or to report its result
+            static unsigned _async_events(registration const& reg)
+            {
+                unsigned ev = none;
+                if(!reg.io)
+                    return ev;
+                auto const& io = *reg.io;
+                if((reg.async & reg.events & read) && (io.rdone || (!io.rposted && !io.reof)))
+                    ev |= read;
+                if((reg.async & reg.events & write) && (io.wdone || !io.wposted))
+                    ev |= write;
+                return ev;
+            }
+
+            bool _async_ready() const
+            {
+                for(auto fd : _attached)
+                {
+                    if(_async_events(_regs[fd]) != none)
+                        return true;
+                }
+                return false;
+            }
+
+            void _attach(file_descriptor fd, unsigned direction)
+            {
+                auto& reg = _reg(fd);
+                if(!reg.io)
+                {
+                    reg.io.reset(new async_io);
+                    _attached.push_back(fd);
+                }
+                reg.async |= direction;
+            }
+
+            void _submit_read(file_descriptor fd, async_io& io)
+            {
+                auto* sqe = _get_sqe();
+                sqe->opcode = IORING_OP_READ;
+                sqe->fd = fd;
+                sqe->addr = reinterpret_cast<__u64>(io.rbuf);
+                sqe->len = static_cast<__u32>(std::min<std::size_t>(io.rlen, INT_MAX));
+                sqe->off = ~__u64(0); // current file position
+                sqe->user_data = _user_data(READ, fd, 0);
+                io.rposted = true;
+            }
+
+            void _submit_write(file_descriptor fd, async_io& io)
+            {
+                auto* sqe = _get_sqe();
+                sqe->fd = fd;
+                if(io.wiov.size() == 1)
+                {
+                    sqe->opcode = IORING_OP_WRITE;
+                    sqe->addr = reinterpret_cast<__u64>(io.wiov[0].iov_base);
+                    sqe->len = static_cast<__u32>(std::min<std::size_t>(io.wiov[0].iov_len, INT_MAX));
+                } else
+                {
+                    sqe->opcode = IORING_OP_WRITEV;
+                    sqe->addr = reinterpret_cast<__u64>(io.wiov.data());
+                    sqe->len = static_cast<__u32>(io.wiov.size());
+                }
+                sqe->off = ~__u64(0); // current file position
+                sqe->user_data = _user_data(WRITE, fd, 0);
+                io.wposted = true;
+            }
+
+            void _read_done(file_descriptor fd, async_io& io, int res)
+            {
+                io.rposted = false;
+                if(_closing)
+                    return;
+                if(res == -EAGAIN)
+                {
+                    // non-blocking fd without data: wait for it with a linked poll
+                    _poll_link(fd, POLLIN, READ);
+                    _submit_read(fd, io);
+                } else if(res == -EINTR || res == -ECANCELED)
+                    _submit_read(fd, io);
+                else
+                {
+                    io.rres = res;
+                    io.rdone = true;
+                }
+            }
+
+            void _write_done(file_descriptor fd, async_io& io, int res)
+            {
+                io.wposted = false;
+                if(_closing)
+                    return;
+                if(res == -EAGAIN)
+                {
+                    _poll_link(fd, POLLOUT, WRITE);
+                    _submit_write(fd, io);
+                } else if(res == -EINTR || res == -ECANCELED)
+                    _submit_write(fd, io);
+                else
+                {
+                    io.wres = res;
+                    io.wdone = true;
+                }
+            }
+
+            // poll request that the next SQE (a read or write of kind) waits for
+            void _poll_link(file_descriptor fd, unsigned events, unsigned kind)
+            {
+                auto* sqe = _get_sqe();
+                sqe->opcode = IORING_OP_POLL_ADD;
+                sqe->fd = fd;
+                sqe->poll32_events = events;
+                sqe->flags = IOSQE_IO_LINK;
+                sqe->user_data = _user_data(INTERNAL, fd, kind);
+            }
+
+            void _cancel(__u64 user_data)
+            {
+                auto* sqe = _get_sqe();
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = -1;
+                sqe->addr = user_data;
+                sqe->user_data = REMOVE_USER_DATA;
+            }
+
+            int _enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+            {
+                int ret = static_cast<int>(syscall(__NR_io_uring_enter, _ring_fd, to_submit, min_complete,
+                            flags, nullptr, 0));
+                if(ret >= 0)
+                    _pending -= std::min<unsigned>(_pending, static_cast<unsigned>(ret));
+                return ret;
+            }
+
+            // get the next free SQE, submits queued entries if the ring is full
+            struct io_uring_sqe* _get_sqe()
+            {
+                unsigned tail = *_sq_tail;
+                while(tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _sq_entries)
+                {
+                    if(_enter(_pending, 0, 0) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                        throw system_error(errno);
+                }
+                unsigned idx = tail & _sq_mask;
+                auto* sqe = &_sqes[idx];
+                std::memset(sqe, 0, sizeof(*sqe));
+                _sq_array[idx] = idx;
+                __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+                ++_pending;
+                return sqe;
+            }
+
+            void _arm(file_descriptor fd, registration& reg)
+            {
+                unsigned events = _poll_events(reg);
+                auto* sqe = _get_sqe();
+                sqe->opcode = IORING_OP_POLL_ADD;
+                sqe->fd = fd;
+                sqe->poll32_events = (events & read ? POLLIN : 0) | (events & write ? POLLOUT : 0)
+                    | (events & except ? POLLPRI : 0);
+                sqe->user_data = _user_data(POLL, fd, reg.gen);
+                reg.armed = true;
+            }
+
+            void _unmap()
+            {
+                munmap(_sq_ring, _sq_ring_size);
+                if(_cq_ring != _sq_ring)
+                    munmap(_cq_ring, _cq_ring_size);
+            }
+
+            int _ring_fd;
+            void* _sq_ring = nullptr;
+            void* _cq_ring = nullptr;
+            size_t _sq_ring_size, _cq_ring_size, _sqes_size;
+            struct io_uring_sqe* _sqes;
+            unsigned *_sq_head, *_sq_tail, *_sq_array, *_cq_head, *_cq_tail;
+            unsigned _sq_mask, _sq_entries, _cq_mask;
+            struct io_uring_cqe* _cqes;
+            unsigned _pending = 0; // queued, not yet submitted SQEs
+            bool _closing = false; // no new requests
+
+            std::vector<registration> _regs; // indexed by fd
+            std::vector<file_descriptor> _rearm; // fds with a completed poll
+            std::vector<file_descriptor> _attached; // fds with completion-based I/O
+    };
+
+    constexpr __u64 uring_poller::REMOVE_USER_DATA;
+#endif
+
+    std::unique_ptr<poller> poller::create(poller_type type)
+    {
+#ifdef HAVE_IO_URING
+        if(type == poller_type::uring)
+        {
+            try
+            {
+                return std::unique_ptr<poller>(new uring_poller);
+            } catch(system_error& e)
+            {
+                std::clog << "io_uring unavailable (" << e.what() << "): falling back to epoll" << std::endl;
+            }
+            type = poller_type::epoll;
+        }
+#else
+        if(type == poller_type::uring)
+        {
+            std::clog << "io_uring not supported by this build: falling back to epoll" << std::endl;
+            type = poller_type::epoll;
+        }
+#endif
+        if(type == poller_type::epoll)
+        {
+            try
+            {
+                return std::unique_ptr<poller>(new epoll_poller);
+            } catch(system_error& e)
+            {
+                std::clog << "epoll unavailable (" << e.what() << "): falling back to select" << std::endl;
+            }
+        }
+        return std::unique_ptr<poller>(new select_poller);
+    }
+
+    poller_type parse_poller_type(std::string const& name)
+    {
+        if(name == "select")
+            return poller_type::select;
+        if(name == "epoll")
+            return poller_type::epoll;
+        if(name == "uring")
+            return poller_type::uring;
+        throw config_error("unknown event backend: " + name);
+    }
+
+    char const* poller_type_name(poller_type type)
+    {
+        switch(type)
+        {
+            case poller_type::select:
+                return "select";
+            case poller_type::epoll:
+                return "epoll";
+            case poller_type::uring:
+                return "uring";
+        }
+        return "unknown";
+    }
+} // namespace smux_client
@@ -0,0 +1,113 @@
+/// \file poller.h
+#ifndef _POLLER_H_INCLUDED_
+#define _POLLER_H_INCLUDED_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file.h"
+#include "errors.h"
+#include "io_engine.h"
+
+namespace smux_client
+{
+    /**
+     * \brief                   event notification mechanism used by the runtime system
+     */
+    enum class poller_type
+    {
+        select, ///< select(2), limited to FD_SETSIZE file descriptors
+        epoll, ///< epoll(7)
+        uring, ///< io_uring(7) reads, writes and polls, falls back to epoll if unavailable
+    };
+
+    /**
+     * \brief                   abstraction of a readiness notification mechanism
+     *
+     * File descriptors are registered once with the events of interest and an opaque data
+     * pointer, which is handed back with each event. Registrations stay valid until changed.
+     */
+    class poller
+    {
+        public:
+            /// event flags
+            enum : unsigned
+            {
+                none = 0,
+                read = 1, ///< readable
+                write = 2, ///< writable
+                except = 4, ///< exceptional condition
+            };
+
+            /// a single ready file descriptor
+            struct event
+            {
+                file_descriptor fd;
+                unsigned events; ///< flags of the ready events
+                void* data; ///< data pointer passed to set()
+            };
+
+            /**
+             * \brief                   create a poller
+             * \param type              requested mechanism
+             * \return                  new poller (select is used if type is unavailable)
+             * \throw                   system_error
+             */
+            static std::unique_ptr<poller> create(poller_type type);
+
+            /**
+             * \brief                   set the events to monitor on a file descriptor
+             * \param fd                file descriptor
+             * \param events            event flags (none removes the file descriptor)
+             * \param data              pointer to hand back with the events of fd
+             * \throw                   system_error
+             */
+            virtual void set(file_descriptor fd, unsigned events, void* data) = 0;
+
+            /**
+             * \brief                   wait for events
+             * \param[out] events       ready file descriptors (empty if interrupted by a signal)
+             * \throw                   system_error
+             */
+            virtual void wait(std::vector<event>& events) = 0;
+
+            /**
+             * \brief                   type of this poller
+             */
+            virtual poller_type type() const = 0;
+
+            /**
+             * \brief                   get the completion-based I/O engine of this poller
+             * \return                  engine for files to read and write through, nullptr if
+             *                          the poller only reports readiness (default)
+             */
+            virtual io_engine* engine()
+            {
+                return nullptr;
+            }
+
+            /**
+             * \brief                   dtor
+             */
+            virtual ~poller()
+            {
+            }
+    };
+
+    /**
+     * \brief                   parse the name of a poller type
+     * \param name              "select", "epoll" or "uring"
+     * \return                  poller type
+     * \throw                   config_error
+     */
+    poller_type parse_poller_type(std::string const& name);
+
+    /**
+     * \brief                   get the name of a poller type
+     */
+    char const* poller_type_name(poller_type type);
+
+} // namespace smux_client
+
+#endif // ifndef _POLLER_H_INCLUDED_
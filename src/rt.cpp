@@ -1,33 +1,37 @@
 // rt.cpp
 #include <cstring>
+#include <exception>
 #include <iostream>
+#include <new>
 
 #include <errno.h>
 #include <signal.h>
 #include <unistd.h>
-#include <sys/select.h>
 
+#include "log.h"
 #include "rt.h"
 
 using namespace smux_client;
 
 void runtime_system::run()
 {
-    buffer buf;
-
     // master files
-    half_channel* master_in = _master.in.get();
-    half_channel* master_out = _master.out.get();
+    half_channel* master_in = _master.in;
+    half_channel* master_out = _master.out;
     if(master_in)
     {
-        // we cannot tell if more characters are available (read(2) does not tell us), but main loop
-        // will call smux.read again if necessary
-        _smux.set_read_fn([master_in](void* buf, size_t count) { return master_in->fl->read(buf, count); });
+        // the file is non-blocking, the read event handler calls smux.read again while
+        // _rx_last shows progress
+        _smux.set_read_fn([this, master_in](void* buf, size_t count) {
+            _rx_requested = count;
+            _rx_last = master_in->fl->read(buf, count);
+            return _rx_last;
+        });
     } else
     {
         // no master_in
         _smux.set_read_fn([](void*, size_t) { return 0; });
-        std::clog << "Warning: no master read file: cannot receive data" << std::endl;
+        log(log_level::warning, log_category::master, "Warning: no master read file: cannot receive data\n");
     }
     if(master_out)
     {
@@ -36,148 +40,249 @@ void runtime_system::run()
     {
         // no master_out
         _smux.set_write_fn([](const void*, size_t count) { return count; });
-        std::clog << "Warning: no master write file: cannot transmit data" << std::endl;
+        log(log_level::warning, log_category::master, "Warning: no master write file: cannot transmit data\n");
     }
 
-    // initially fill _fm and _fs
-    for(auto& channel : _channels)
+    // only receive data for channels that can be written somewhere
+    for(unsigned ch = smux_channel_min; ch <= smux_channel_max; ++ch)
+        _smux.subscribe(static_cast<smux_channel>(ch), false);
+    for(unsigned ch = smux_channel_min; ch <= smux_channel_max; ++ch)
     {
-        _update_fds(channel.second);
+        if(_channels[ch].out)
+            _smux.subscribe(static_cast<smux_channel>(ch));
     }
-    // hook up the master
-    _update_fds(_master);
 
-    // main loop
-    std::clog << "entering main loop" << std::endl;
-    while(true)
+    for(auto& hc : _half_channels)
+        hc.read_size = _read_size;
+
+    // create the event loops
+    for(unsigned i = 0; i < (_split ? 2 : 1); ++i)
+    {
+        _loops[i].index = i;
+        _loops[i].events = poller::create(_poller_type);
+        if(_pipesig_r >= 0)
+            _loops[i].events->set(_pipesig_r, poller::read, nullptr); // setup signal notification pipe
+    }
+    log(log_level::info, log_category::general, "event backend: ", poller_type_name(_loops[0].events->type()), '\n');
+
+    // let completion-based backends perform the I/O of the files, on the loop in charge of it
+    for(auto& hc : _half_channels)
     {
-        fd_sets _fs_tmp = _fs;
-        _fs_tmp.read.set(_pipesig_r); // setup signal notification pipe
-        int nfds = std::max({_fs_tmp.read.fd_max, _fs_tmp.write.fd_max, _fs_tmp.except.fd_max}) + 1;
-        if(0) std::clog << "calling select()..." << std::endl;
-        int select_result = select(nfds, &_fs_tmp.read.fs, &_fs_tmp.write.fs, &_fs_tmp.except.fs, nullptr);
-        if(0) std::clog << "called select()=" << select_result << std::endl;
-        if(select_result < 0)
+        io_engine* engines[2] = {nullptr, nullptr};
+        for(unsigned i = 0; i < (_split ? 2 : 1); ++i)
         {
-            if(errno == EINTR) // tolerate interrupted syscall
-                continue;
-            throw system_error(errno);
+            if(_role(_loops[i], hc) & poller::read)
+                engines[0] = _loops[i].events->engine();
+            if(_role(_loops[i], hc) & poller::write)
+                engines[1] = _loops[i].events->engine();
         }
+        hc.fl->set_io_engine(engines[0], engines[1]);
+        hc.async_read = engines[0] != nullptr;
+    }
 
-        // shutdown signal received?
-        if(_fs_tmp.read.is_set(_pipesig_r))
+    if(!_split)
+    {
+        _run_loop(_loops[0]);
+        return;
+    }
+
+    // split mode: TX pipeline in a second thread, each loop stops the other one on exit
+    log(log_level::info, log_category::general, "starting TX thread\n");
+    std::exception_ptr tx_error;
+    std::thread tx([this, &tx_error] {
+        try
+        {
+            _run_loop(_loops[1]);
+        } catch(...)
         {
-            std::clog << "\nshutdown signal received: exiting main loop" << std::endl;
-            return;
+            tx_error = std::current_exception();
         }
+        shutdown();
+        // hand the blocks cached by this thread back before it exits
+        block_pool::get().flush_cache();
+    });
+    try
+    {
+        _run_loop(_loops[0]);
+    } catch(...)
+    {
+        shutdown();
+        tx.join();
+        throw;
+    }
+    shutdown();
+    tx.join();
+    if(tx_error)
+        std::rethrow_exception(tx_error);
+}
+
+void runtime_system::_run_loop(event_loop& loop)
+{
+    // large enough for the largest read size
+    buffer buf(_adaptive ? std::max<std::size_t>(_read_size, ADAPTIVE_MAX_SIZE) : _read_size);
+    half_channel* master_in = _master.in;
+    half_channel* master_out = _master.out;
+
+    // register all file descriptors
+    for(auto& channel : _channels)
+    {
+        _update_fds(loop, channel);
+    }
+    // hook up the master
+    _update_fds(loop, _master);
+
+    // main loop
+    log(log_level::info, log_category::general, loop.index ? "entering TX loop\n" : "entering main loop\n");
+    std::vector<poller::event> events;
+    while(true)
+    {
+        // idle: write the log before waiting
+        logger::get().drain(std::clog);
+        log(log_level::trace, log_category::general, "waiting for events...\n");
+        loop.events->wait(events);
+        log(log_level::trace, log_category::general, "got ", events.size(), " events\n");
 
-        for(file_descriptor fd = 0; fd < nfds; ++fd)
+        for(auto const& ev : events)
         {
-            // find our half channel associated with fd
-            auto _fm_it = _fm.find(fd);
-            if(_fm_it == _fm.end())
-                continue;
-            auto& hc = *_fm_it->second;
+            // shutdown signal received?
+            if(!ev.data)
+            {
+                log(log_level::info, log_category::general,
+                        loop.index ? "\nshutdown signal received: exiting TX loop\n" : "\nshutdown signal received: exiting main loop\n");
+                return;
+            }
+
+            file_descriptor fd = ev.fd;
+            auto& hc = *static_cast<half_channel*>(ev.data);
 
             // read event
-            if(_fs_tmp.read.is_set(fd) && hc.fl->read_event(fd))
+            if((ev.events & poller::read) && hc.fl->read_event(fd))
             {
                 if(&hc == master_in)
                 {
-                    if(0) std::clog << "master read event" << std::endl;
-                    if(_smux.read() < 0)
-                        throw system_error("reading into smux buffer failed");
-                    if(0) std::clog << "_smux.read() done" << std::endl;
-
-                    if(master_in->fl->eof())
-                    {
-                        std::clog << "\neof on master in -> shutdown" << std::endl;
-                        return;
-                    }
-
-                    // receive data
-                    std::size_t ret;
+                    log(log_level::debug, log_category::master, "master read event\n");
+                    // read and decode until the master would block, the budget is used up or
+                    // decoding is blocked (then the smux buffer stays full and nothing is read)
+                    std::size_t total = 0;
+                    bool limited = false;
                     do
                     {
-                        smux_channel ch;
-                        buf.resize(RECEIVE_BUFFER_SIZE);
-                        ret = _smux.recv(&ch, buf.data(), buf.size());
+                        _rx_last = 0;
+                        if(_smux.read() < 0)
+                            throw system_error("reading into smux buffer failed");
+                        total += _rx_last;
+                        limited |= _rx_last > 0 && _rx_last == _rx_requested;
 
-                        // forward data to the correct output
-                        if(ret > 0)
+                        if(master_in->fl->eof())
                         {
-                            if(_channels.count(ch))
-                            {
-                                auto& hc_out = _channels[ch].out;
-                                if(hc_out)
-                                {
-                                    auto& out_buffer = hc_out->out_buffer;
-                                    buf.resize(ret); // remember correct size
-                                    if(out_buffer.size() == 0) // no data waiting currently?
-                                        out_buffer = std::move(buf);
-                                    else
-                                        out_buffer.insert(out_buffer.end(), buf.begin(), buf.end());
-                                    _update_fds(*hc_out);
-                                    if(0) std::clog << "received data for channel " << static_cast<int>(ch) << std::endl;
-                                }
-                            } else // channel not existing
-                            {
-                                std::clog << "\nignoring data for channel " << static_cast<int>(ch) << std::endl;
-                            }
+                            log(log_level::info, log_category::master, "\neof on master in -> shutdown\n");
+                            return;
                         }
-                    } while(ret != 0);
+
+                        // receive data
+                        _receive(buf);
+                    } while(_rx_last > 0 && total < READ_BUDGET && !master_in->paused);
+
+                    // fit the read buffer to the traffic (only possible while it is empty and
+                    // not being read into)
+                    if(_adaptive && !master_in->fl->read_pending())
+                    {
+                        std::size_t size = _smux.read_buf_size();
+                        std::size_t next = _adapt_size(size, limited, total);
+                        if(next != size && _smux.resize_read_buf(next))
+                            log(log_level::debug, log_category::master, "smux read buffer: ", next, " bytes\n");
+                    }
                 } else
                 {
                     // a channel is ready to be read
-                    if(0) std::clog << "read event on channel " << static_cast<int>(hc.ch) << ", fd=" << fd << std::endl;
-                    buf.resize(RECEIVE_BUFFER_SIZE);
+                    log(log_level::debug, log_category::channel, "read event on channel ", static_cast<int>(hc.ch), ", fd=", fd, '\n');
 
-                    std::size_t ret = hc.fl->read(buf.data(), buf.size());
-                    if(hc.fl->eof())
-                        std::clog << "\neof on channel " << static_cast<int>(hc.ch) << std::endl;
-                    if(ret > 0)
+                    // reads completing in the background need a buffer of their own, it is
+                    // only resized while unused
+                    buffer& rx = hc.async_read ? hc.rx : buf;
+                    if(rx.size() < hc.read_size && !hc.fl->read_pending())
+                        rx.resize(hc.read_size);
+                    std::size_t size = std::min(hc.read_size, rx.size());
+
+                    // read until the file would block, the budget is used up or the master
+                    // TX queue is too full
+                    std::size_t total = 0, ret;
+                    bool limited = false;
+                    while(total < READ_BUDGET && !hc.paused && (ret = hc.fl->read(rx.data(), size)) > 0)
                     {
-                        std::clog << '<' << static_cast<int>(hc.ch) << std::flush;
+                        total += ret;
+                        limited |= ret == size;
                         // forward data to smux
-                        smux::ostream out(_smux, hc.ch);
-                        out.write(buf.data(), ret);
-                        out.flush();
+                        _transmit(hc.ch, rx.data(), ret);
                     }
+                    if(_adaptive)
+                        hc.read_size = _adapt_size(hc.read_size, limited, total);
+                    if(total > 0)
+                        log(log_level::trace, log_category::data, '<', static_cast<int>(hc.ch));
+                    if(hc.fl->eof())
+                        log(log_level::info, log_category::channel, "\neof on channel ", static_cast<int>(hc.ch), '\n');
                 }
             }
 
             // write event
-            if(_fs_tmp.write.is_set(fd) && hc.fl->write_event(fd))
+            if((ev.events & poller::write) && hc.fl->write_event(fd))
             {
                 if(&hc == master_out)
                 {
-                    if(0) std::clog << "master write event" << std::endl;
-                    // master is written directly as it is the bottleneck anyway
+                    log(log_level::debug, log_category::master, "master write event\n");
+                    ssize_t ret = _smux.write();
+                    if(ret < 0)
+                        throw system_error("writing smux data failed");
+                    _tx_pending = static_cast<std::size_t>(ret);
+                    _update_tx_pause();
+
+                    // drained: fit the write buffer to the peak of the burst
+                    if(_adaptive && _tx_pending == 0)
+                    {
+                        std::size_t size = _smux.write_buf_size();
+                        std::size_t next = _adapt_size(size, _tx_peak > size, _tx_peak);
+                        if(next != size && _smux.resize_write_buf(next))
+                            log(log_level::debug, log_category::master, "smux write buffer: ", next, " bytes\n");
+                        _tx_peak = 0;
+                    }
                 } else
                 {
                     // a channel is ready to be written
-                    if(0) std::clog << "write event on channel " << static_cast<int>(hc.ch) << ", fd=" << fd << std::endl;
-                    std::clog << '>' << static_cast<int>(hc.ch) << std::flush;
-                    if(hc.out_buffer.size() > 0)
+                    log(log_level::debug, log_category::channel, "write event on channel ", static_cast<int>(hc.ch), ", fd=", fd, '\n');
+                    log(log_level::trace, log_category::data, '>', static_cast<int>(hc.ch));
+                    // write until the queue is empty or the file would block
+                    if(hc.out_buffer.empty())
+                        _consume_output(hc, 0, buf); // reload spilled data
+                    while(!hc.out_buffer.empty())
                     {
-                        std::size_t ret = hc.fl->write(hc.out_buffer.data(), hc.out_buffer.size());
-                        auto begin = hc.out_buffer.begin();
-                        hc.out_buffer.erase(begin, begin + ret);
+                        struct iovec iov[WRITEV_MAX_CHUNKS];
+                        int iovcnt = hc.out_buffer.fill_iovec(iov, WRITEV_MAX_CHUNKS);
+                        std::size_t requested = 0;
+                        for(int i = 0; i < iovcnt; ++i)
+                            requested += iov[i].iov_len;
+                        std::size_t written = hc.fl->writev(iov, iovcnt);
+                        _consume_output(hc, written, buf);
+                        if(written < requested)
+                            break;
                     }
+
+                    // continue receiving if the write made room
+                    if(master_in && master_in->paused && !_blocked())
+                        _receive(buf);
                 }
             }
 
             // exception
-            if(_fs_tmp.except.is_set(fd))
+            if(ev.events & poller::except)
             {
-                std::clog << "\nexcept event on " << fd << std::endl;
+                log(log_level::warning, log_category::channel, "\nexcept event on ", fd, '\n');
 
                 // call exception handler
                 hc.fl->exception_event(fd);
             }
 
             // give the file a chance to update its fd sets
-            _update_fds(hc);
+            _update_fds(loop, hc);
         }
     }
 }
@@ -195,6 +300,10 @@ void runtime_system::shutdown()
 
 runtime_system::~runtime_system()
 {
+    // the files must not use the engines of the destroyed event loops
+    for(auto& hc : _half_channels)
+        hc.fl->set_io_engine(nullptr, nullptr);
+
     // close signal notification pipe
     if(_pipesig_r >= 0)
         close(_pipesig_r);
@@ -202,58 +311,242 @@ runtime_system::~runtime_system()
         close(_pipesig_w);
 }
 
-void runtime_system::_update_fds(half_channel& hc)
+void runtime_system::_receive(buffer& buf)
 {
-    // ask file for its file descriptors
-    file_descriptor_set read_fds, write_fds, except_fds;
-    hc.fl->select_fds(read_fds, write_fds, except_fds, hc.out_buffer.size() != 0);
+    while(!_blocked())
+    {
+        smux_channel ch;
+        std::size_t ret = _smux.recv(&ch, buf.data(), buf.size());
+        if(ret == 0)
+            break;
+
+        // forward data to the correct output (only subscribed channels are received)
+        auto* hc_out = _channels[ch].out;
+        _queue_output(*hc_out, buf.data(), ret);
+        _update_fds(_rx_loop(), *hc_out);
+        log(log_level::debug, log_category::master, "received data for channel ", static_cast<int>(ch), '\n');
+    }
 
-    // remove all old file descriptors
-    for(auto const& fds : {hc.fds.read, hc.fds.write, hc.fds.except})
+    // stop or resume reading the master; undecoded data stays in the smux buffer
+    auto* master_in = _master.in;
+    bool blocked = _blocked();
+    if(master_in && master_in->paused != blocked)
     {
-        for(auto const& fd : fds)
-        {
-            _fm.erase(fd);
+        master_in->paused = blocked;
+        if(blocked)
+            ++_budget_stats.blocks;
+        _update_fds(_rx_loop(), *master_in);
+    }
+}
+
+void runtime_system::_transmit(smux_channel ch, const char* data, std::size_t count)
+{
+    // a single send takes at most one frame, the elastic buffer takes everything unless
+    // memory runs out
+    for(std::size_t done = 0; done < count;)
+    {
+        std::size_t n = _smux.send(ch, data + done, count - done);
+        if(!n)
+            throw system_error(ENOMEM, "queueing data for the master failed");
+        done += n;
+    }
+
+    // encoded bytes, as reported by _smux.write() on write events
+    bool idle = _tx_pending == 0;
+    _tx_pending = _smux.write_pending();
+    _tx_peak = std::max(_tx_peak, _tx_pending);
+    if(!_master.out)
+    {
+        // nobody to write to, discard right away
+        _tx_pending = static_cast<std::size_t>(_smux.write());
+    } else if(idle)
+        _update_fds(_tx_loop(), *_master.out); // start waiting for write readiness
+    _update_tx_pause();
+}
+
+void runtime_system::_update_tx_pause()
+{
+    bool pause = _tx_paused;
+    if(_tx_pending >= TX_HIGH_WATERMARK)
+        pause = true;
+    else if(_tx_pending <= TX_LOW_WATERMARK)
+        pause = false;
+    if(pause == _tx_paused)
+        return;
 
-            // we assume that a fd uniquely belongs to a single file
-            _fs.read.clear(fd);
-            _fs.write.clear(fd);
-            _fs.except.clear(fd);
+    _tx_paused = pause;
+    for(auto& channel : _channels)
+    {
+        if(channel.in)
+        {
+            channel.in->paused = pause;
+            _update_fds(_tx_loop(), *channel.in);
         }
     }
+}
 
-    // add the new definitions
-    for(auto const& fd : read_fds)
+void runtime_system::_queue_output(half_channel& hc, const char* data, std::size_t count)
+{
+    switch(_budget.policy)
     {
-        _fm[fd] = &hc;
-        _fs.read.set(fd);
+        case budget_policy::block:
+            // limits are enforced by _receive()
+            break;
+        case budget_policy::drop:
+            {
+                std::size_t excess = _excess(hc, count);
+                if(excess)
+                {
+                    // drop the oldest data: first queued, then the beginning of the new data
+                    // (queued data is kept while it is being written in the background)
+                    std::size_t queued = hc.fl->write_pending() ? 0 : std::min(excess, hc.out_buffer.size());
+                    hc.out_buffer.consume(queued);
+                    _account(hc, 0, queued);
+                    std::size_t fresh = std::min(excess - queued, count);
+                    data += fresh;
+                    count -= fresh;
+                    ++_budget_stats.drops;
+                    _budget_stats.dropped_bytes += queued + fresh;
+                }
+            }
+            break;
+        case budget_policy::spill:
+            // once spilling, everything goes to the file to keep the order; an empty queue
+            // takes the data anyway (like reloading does), so the channel keeps being written
+            if(!hc.spill.empty() || (!hc.out_buffer.empty() && _excess(hc, count)))
+            {
+                hc.spill.append(data, count);
+                ++_budget_stats.spills;
+                _budget_stats.spilled_bytes += count;
+                return;
+            }
+            break;
     }
-    for(auto const& fd : write_fds)
+
+    hc.out_buffer.append(data, count);
+    _account(hc, count, 0);
+}
+
+void runtime_system::_consume_output(half_channel& hc, std::size_t count, buffer& buf)
+{
+    hc.out_buffer.consume(count);
+    _account(hc, 0, count);
+
+    // reload spilled data while it fits into the budget (always if the queue ran empty)
+    while(!hc.spill.empty())
     {
-        _fm[fd] = &hc;
-        _fs.write.set(fd);
+        std::size_t n = std::min(hc.spill.size(), buf.size());
+        if(!hc.out_buffer.empty() && _excess(hc, n))
+            break;
+        n = hc.spill.take(buf.data(), n);
+        hc.out_buffer.append(buf.data(), n);
+        _account(hc, n, 0);
     }
-    for(auto const& fd : except_fds)
+}
+
+unsigned runtime_system::_role(event_loop const& loop, half_channel const& hc) const
+{
+    if(!_split)
+        return poller::read | poller::write | poller::except;
+
+    // RX: master in -> channel outputs, TX: channel inputs -> master out
+    unsigned events = poller::none;
+    if(loop.index == 0)
+    {
+        if(&hc == _master.in)
+            events |= poller::read | poller::except;
+        if(&hc == _channels[hc.ch].out)
+            events |= poller::write;
+    } else
+    {
+        if(&hc == _channels[hc.ch].in)
+            events |= poller::read | poller::except;
+        if(&hc == _master.out)
+            events |= poller::write;
+    }
+    return events;
+}
+
+void runtime_system::_update_fds(event_loop& loop, half_channel& hc)
+{
+    // only look at the state owned by this loop (the other one may change the rest)
+    unsigned role = _role(loop, hc);
+    bool data_present = (role & poller::write)
+        && (&hc == _master.out ? _tx_pending > 0 : !hc.out_buffer.empty() || !hc.spill.empty());
+
+    // ask file for its file descriptors
+    auto& new_fds = loop.new_fds;
+    new_fds.read.clear();
+    new_fds.write.clear();
+    new_fds.except.clear();
+    hc.fl->select_fds(new_fds.read, new_fds.write, new_fds.except, data_present);
+    if(!(role & poller::read) || hc.paused)
+        new_fds.read.clear();
+    if(!(role & poller::write))
+        new_fds.write.clear();
+    if(!(role & poller::except))
+        new_fds.except.clear();
+    auto& fds = hc.fds[loop.index];
+
+    // (re-)register every old and new file descriptor with its current events, the
+    // poller skips unchanged registrations
+    auto update = [&](file_descriptor fd) {
+        unsigned events = (new_fds.read.count(fd) ? poller::read : poller::none)
+            | (new_fds.write.count(fd) ? poller::write : poller::none)
+            | (new_fds.except.count(fd) ? poller::except : poller::none);
+        loop.events->set(fd, events, &hc);
+    };
+    for(auto const& set : {&fds.read, &fds.write, &fds.except,
+            &new_fds.read, &new_fds.write, &new_fds.except})
     {
-        _fm[fd] = &hc;
-        _fs.except.set(fd);
+        for(auto const& fd : *set)
+            update(fd);
     }
 
-    // finally, remember the new sets
-    hc.fds.read = std::move(read_fds);
-    hc.fds.write = std::move(write_fds);
-    hc.fds.except = std::move(except_fds);
+    // finally, remember the new sets (the old ones are kept as scratch space)
+    fds.read.swap(new_fds.read);
+    fds.write.swap(new_fds.write);
+    fds.except.swap(new_fds.except);
 }
 
 void runtime_system::_setup_shutdown_pipe()
 {
-    std::clog << "initialize shutdown pipe" << std::endl;
+    log(log_level::info, log_category::general, "initialize shutdown pipe\n");
     int pipefd[2];
     if(pipe(pipefd))
-        std::clog << "error initializing shutdown notification: " << std::strerror(errno) << std::endl;
+        log(log_level::error, log_category::general, "error initializing shutdown notification: ", std::strerror(errno), '\n');
     else
     {
         _pipesig_r = pipefd[0];
         _pipesig_w = pipefd[1];
     }
 }
+
+void runtime_system::_setup_tx_segments()
+{
+    auto& elastic = _smux.sender_type::smux()->elastic;
+    elastic.alloc_fn = _alloc_tx_segment;
+    elastic.release_fn = _release_tx_segment;
+    elastic.alloc_fd = nullptr;
+    elastic.segment_size = block_pool::BLOCK_SIZE;
+    elastic.max_size = 0;
+}
+
+void* runtime_system::_alloc_tx_segment(void*, std::size_t size)
+{
+    if(size > block_pool::BLOCK_SIZE)
+        return nullptr;
+    try
+    {
+        return block_pool::get().allocate();
+    }
+    catch(std::bad_alloc const&)
+    {
+        return nullptr;
+    }
+}
+
+void runtime_system::_release_tx_segment(void*, void* segment)
+{
+    block_pool::get().deallocate(segment);
+}
@@ -3,15 +3,21 @@
 #define _RT_H_INCLUDED_
 
 #include <algorithm>
+#include <array>
+#include <deque>
 #include <memory>
+#include <thread>
 #include <utility>
 #include <vector>
-#include <unordered_map>
 
 #include <smux.hpp>
 
+#include "block_pool.h"
+#include "budget.h"
+#include "chunk_queue.h"
 #include "file.h"
 #include "error.h"
+#include "poller.h"
 
 namespace smux_client
 {
@@ -26,40 +32,45 @@ namespace smux_client
         public:
             enum
             {
-                RECEIVE_BUFFER_SIZE = 2048, ///< size of receive buffers in runtime_system
-                SMUX_BUFFER_SIZE = 4096, ///< size of buffers in smux
+                RECEIVE_BUFFER_SIZE = 2048, ///< default size of receive buffers in runtime_system
+                SMUX_BUFFER_SIZE = 4096, ///< default size of buffers in smux
+                ADAPTIVE_MIN_SIZE = 512, ///< lower bound of adaptive buffer sizes
+                ADAPTIVE_MAX_SIZE = 64 * 1024, ///< upper bound of adaptive buffer sizes
+                WRITEV_MAX_CHUNKS = 16, ///< maximum number of queued chunks written at once
+                READ_BUDGET = 64 * 1024, ///< maximum number of bytes read from a file per event
+                TX_HIGH_WATERMARK = 64 * 1024, ///< pending master output that pauses channel reading
+                TX_LOW_WATERMARK = 16 * 1024, ///< pending master output that resumes channel reading
             };
 
             /**
              * \brief                   ctor
              * \param master_in         file to read smux data from
              * \param master_out        file to write smux data to
+             * \throw                   system_error
              */
             runtime_system(std::unique_ptr<file> master_in, std::unique_ptr<file> master_out)
                 : _smux(SMUX_BUFFER_SIZE)
             {
                 _setup_shutdown_pipe();
+                _setup_tx_segments();
 
-                if(master_in)
-                    _master.in = std::make_shared<half_channel>(0, std::move(master_in));
-                if(master_out)
-                    _master.out = std::make_shared<half_channel>(0, std::move(master_out));
+                _master.in = _add_half_channel(0, std::move(master_in));
+                _master.out = _add_half_channel(0, std::move(master_out));
             }
 
             /**
              * \brief                   ctor
              * \param master            file to read/write smux data
+             * \throw                   system_error
              */
             runtime_system(std::unique_ptr<file> master)
                 : _smux(SMUX_BUFFER_SIZE)
             {
                 _setup_shutdown_pipe();
+                _setup_tx_segments();
 
-                if(master)
-                {
-                    _master.in = std::make_shared<half_channel>(0, std::move(master));
-                    _master.out = _master.in;
-                }
+                _master.in = _add_half_channel(0, std::move(master));
+                _master.out = _master.in;
             }
 
             /**
@@ -67,39 +78,105 @@ namespace smux_client
              * \param ch                the associated smux channel
              * \param in                file for reading
              * \param out               file for writing
+             * \throw                   system_error
              */
             void add_channel(smux_channel ch, std::unique_ptr<file> in, std::unique_ptr<file> out)
             {
                 auto& channel = _channels[ch];
                 if(in)
-                {
-                    auto half_channel_in = std::make_shared<half_channel>(ch, std::move(in));
-                    channel.in = half_channel_in;
-                }
+                    channel.in = _add_half_channel(ch, std::move(in));
                 if(out)
-                {
-                    auto half_channel_out = std::make_shared<half_channel>(ch, std::move(out));
-                    channel.out = half_channel_out;
-                }
+                    channel.out = _add_half_channel(ch, std::move(out));
             }
 
             /**
              * \brief                   add a new channel with equal input and ouput file
              * \param ch                the associated channel
              * \param io                file for reading and writing
+             * \throw                   system_error
              */
             void add_channel(smux_channel ch, std::unique_ptr<file> io)
             {
                 if(io)
                 {
-                    auto half_channel_io = std::make_shared<half_channel>(ch, std::move(io));
-
                     auto& channel = _channels[ch];
-                    channel.in = half_channel_io;
-                    channel.out = half_channel_io;
+                    channel.in = _add_half_channel(ch, std::move(io));
+                    channel.out = channel.in;
                 }
             }
 
+            /**
+             * \brief                   select the event notification mechanism
+             * \param type              mechanism to use in run() (default: epoll)
+             */
+            void set_poller_type(poller_type type)
+            {
+                _poller_type = type;
+            }
+
+            /**
+             * \brief                   set the buffer sizes
+             * \param read_size         number of bytes read from a file at once
+             * \param smux_size         size of the smux read and write buffers (>= 16)
+             *
+             * Must be called before run().
+             */
+            void set_buffer_sizes(std::size_t read_size, std::size_t smux_size)
+            {
+                _read_size = read_size;
+                _smux.resize_write_buf(smux_size);
+                _smux.resize_read_buf(smux_size);
+            }
+
+            /**
+             * \brief                   enable adaptive buffer sizes
+             * \param adaptive          true to adapt read sizes and smux buffers to the traffic
+             *
+             * The sizes set with set_buffer_sizes() are used as initial values. Read sizes of
+             * channels and the smux buffers grow if they limited the transfer and shrink again
+             * if they are mostly unused, within ADAPTIVE_MIN_SIZE and ADAPTIVE_MAX_SIZE.
+             */
+            void set_adaptive(bool adaptive)
+            {
+                _adaptive = adaptive;
+            }
+
+            /**
+             * \brief                   enable the split into an RX and a TX thread
+             * \param split             true to run the TX pipeline (channel inputs -> smux ->
+             *                          master out) in a second thread
+             *
+             * The RX pipeline (master in -> smux -> channel outputs) stays in the thread calling
+             * run(). The threads share the smux connection without locking: the TX thread only
+             * uses its sender (sending, writing and resizing the write buffer), the RX thread
+             * only its receiver (reading, receiving and resizing the read buffer), which own
+             * disjoint fields (see smux.h). Everything else is owned by one thread: the master
+             * in, the channel outputs, their budgets and _rx_* by the RX thread, the master out,
+             * the channel inputs and _tx_* by the TX thread.
+             */
+            void set_split(bool split)
+            {
+                _split = split;
+            }
+
+            /**
+             * \brief                   set the limits for pending channel output
+             * \param budget            limits and policy to apply when they are reached
+             */
+            void set_budget(budget_config const& budget)
+            {
+                _budget = budget;
+            }
+
+            /**
+             * \brief                   get the budget accounting
+             * \return                  pending bytes and how often the budget policy triggered
+             */
+            budget_counters const& budget_stats() const
+            {
+                return _budget_stats;
+            }
+
             /**
              * \brief                   main function
              *
@@ -125,103 +202,234 @@ namespace smux_client
         private:
             using buffer = std::vector<char>;
 
-            /// sets of file descriptors for select()
-            struct fd_sets
-            {
-                struct __inner
-                {
-                    fd_set fs;
-                    int fd_max;
-
-                    __inner()
-                    {
-                        zero();
-                    }
-                    void zero()
-                    {
-                        FD_ZERO(&fs);
-                        fd_max = 0;
-                    }
-                    bool is_set(file_descriptor fd) const
-                    {
-                        return FD_ISSET(fd, &fs);
-                    }
-                    void clear(file_descriptor fd)
-                    {
-                        FD_CLR(fd, &fs);
-                    }
-                    void set(file_descriptor fd)
-                    {
-                        FD_SET(fd, &fs);
-                        fd_max = std::max(fd, fd_max);
-                    }
-                }
-                read, write, except;
-            };
-
             /// file descriptors of a single file
             struct file_fds
             {
                 file_descriptor_set read, write, except;
             };
 
-            /// one half of a channel (in or out)
+            /// one half of a channel (in or out), only the data touched on events
             struct half_channel
             {
+                file* const fl; // owned by _files
+                chunk_queue out_buffer; // characters to be written soon (RX)
+                spill_file spill; // characters beyond the budget (spill policy, RX)
+                file_fds fds[2]; // registrations, indexed by event loop
+                std::size_t read_size = 0; // bytes per read (loop reading the file)
+                buffer rx; // read buffer of its own if reads complete in the background
+                bool async_read = false; // reads are performed by an I/O engine (into rx)
                 smux_channel const ch;
-                std::unique_ptr<file> const fl;
-                file_fds fds;
-                buffer out_buffer; // characters to be written soon
+                bool full = false; // out_buffer reached the channel budget (RX)
+                bool paused = false; // not polled for reading (by the loop reading the file)
 
-                half_channel(smux_channel ch_, std::unique_ptr<file> fl_)
-                    : ch(ch_)
-                      , fl(std::move(fl_))
+                half_channel(smux_channel ch_, file* fl_)
+                    : fl(fl_)
+                    , ch(ch_)
                 {}
             };
 
             /// two half channels form a channel (in can be equal to out)
             struct channel
             {
-                std::shared_ptr<half_channel> in;
-                std::shared_ptr<half_channel> out;
+                half_channel* in = nullptr;
+                half_channel* out = nullptr;
             };
 
-            // map with definitions of all channels
-            using channel_map = std::unordered_map<smux_channel, channel>;
-            // lookup map to fastly find a half_channel on a select event
-            using fd_map = std::unordered_map<file_descriptor, half_channel*>;
+            // table of all channels, indexed by channel number
+            using channel_table = std::array<channel, smux_channel_max + 1>;
+
+            /// event loop of a thread
+            struct event_loop
+            {
+                std::unique_ptr<poller> events; // events carry the half channel of the fd
+                file_fds new_fds; // scratch sets for _update_fds()
+                unsigned index = 0; // selects half_channel::fds
+            };
 
-            // (de)muxer
+            // (de)muxer, its write buffer is the TX queue of the master
             smux::connection _smux;
+            // number of bytes read from the master by the last smux read and requested by it
+            std::size_t _rx_last = 0, _rx_requested = 0;
+            // number of encoded bytes waiting to be written to the master and their maximum
+            // since the last time the master was drained
+            std::size_t _tx_pending = 0, _tx_peak = 0;
+            // buffer sizes
+            std::size_t _read_size = RECEIVE_BUFFER_SIZE;
+            bool _adaptive = false;
+            // channel reading paused because of _tx_pending
+            bool _tx_paused = false;
             // master file
             channel _master;
             // all channels go here
-            channel_map _channels;
-            // map of all file descriptors to their half channels
-            fd_map _fm;
-            // file descritor sets for select()
-            fd_sets _fs;
+            channel_table _channels;
+            // storage of all half channels (stable addresses)
+            std::deque<half_channel> _half_channels;
+            // owners of the files, not needed on events
+            std::vector<std::unique_ptr<file>> _files;
+            // [0] handles everything, or RX only in split mode, [1] is the TX loop in split mode
+            event_loop _loops[2];
+            bool _split = false;
+            poller_type _poller_type = poller_type::epoll;
+            // limits for out_buffers and their accounting
+            budget_config _budget;
+            budget_counters _budget_stats;
+            unsigned _full_channels = 0; // number of half channels with full set
             // pipe that becomes readable on shutdown signal reception
             int _pipesig_r = -1, _pipesig_w;
 
 
             /**
-             * \brief                   update a fd_map and fd_sets wrt. a single file
+             * \brief                   wait for and handle events until shutdown
+             * \param loop              event loop of the calling thread
+             * \throw                   system_error
+             */
+            void _run_loop(event_loop& loop);
+
+            // loop handling master reads and channel writes
+            event_loop& _rx_loop()
+            {
+                return _loops[0];
+            }
+
+            // loop handling channel reads and master writes
+            event_loop& _tx_loop()
+            {
+                return _loops[_split ? 1 : 0];
+            }
+
+            /**
+             * \brief                   get the events a loop monitors for a file
+             * \param loop              event loop
+             * \param hc                channel
+             * \return                  poller event flags
+             */
+            unsigned _role(event_loop const& loop, half_channel const& hc) const;
+
+            /**
+             * \brief                   update the poller registrations of a single file
+             * \param loop              event loop to update
              * \param hc                channel to re-query for file descriptors
              */
-            void _update_fds(half_channel& hc);
+            void _update_fds(event_loop& loop, half_channel& hc);
 
             // wrapper for function above taking care of calling it once or twice for channels with separate in/out
-            void _update_fds(channel& c)
+            void _update_fds(event_loop& loop, channel& c)
             {
                 if(c.in)
-                    _update_fds(*c.in);
+                    _update_fds(loop, *c.in);
                 if(c.in != c.out && c.out)
-                    _update_fds(*c.out);
+                    _update_fds(loop, *c.out);
+            }
+
+            /**
+             * \brief                   queue data for writing to a channel, applying the budget policy
+             * \param hc                channel
+             * \param data              data
+             * \param count             number of bytes
+             */
+            void _queue_output(half_channel& hc, const char* data, std::size_t count);
+
+            /**
+             * \brief                   remove written data from a channel's queue
+             * \param hc                channel
+             * \param count             number of bytes written
+             * \param buf               scratch buffer for reloading spilled data
+             */
+            void _consume_output(half_channel& hc, std::size_t count, buffer& buf);
+
+            /**
+             * \brief                   queue data for the master
+             * \param ch                channel
+             * \param data              data
+             * \param count             number of bytes
+             * \throw                   system_error
+             *
+             * The data is written on the next write event of the master.
+             */
+            void _transmit(smux_channel ch, const char* data, std::size_t count);
+
+            /**
+             * \brief                   pause or resume reading channels according to the TX watermarks
+             */
+            void _update_tx_pause();
+
+            /**
+             * \brief                   adapt the size of a buffer to its use (adaptive mode)
+             * \param size              current size
+             * \param limited           true if the buffer size limited a transfer
+             * \param used              bytes transferred using the buffer
+             * \return                  new size
+             */
+            static std::size_t _adapt_size(std::size_t size, bool limited, std::size_t used)
+            {
+                if(limited)
+                    return std::min<std::size_t>(size * 2, ADAPTIVE_MAX_SIZE);
+                if(used < size / 4)
+                    return std::max<std::size_t>(size / 2, ADAPTIVE_MIN_SIZE);
+                return size;
+            }
+
+            /**
+             * \brief                   decode received data while the budget allows it
+             * \param buf               scratch buffer
+             *
+             * Pauses reading the master if the block policy triggers.
+             */
+            void _receive(buffer& buf);
+
+            // true if the block policy requires to stop reading the master
+            bool _blocked() const
+            {
+                return _budget.policy == budget_policy::block && (_full_channels > 0
+                        || (_budget.global_limit && _budget_stats.pending >= _budget.global_limit));
+            }
+
+            // number of bytes by which appending count bytes to hc would exceed the budget
+            std::size_t _excess(half_channel const& hc, std::size_t count) const
+            {
+                std::size_t excess = 0;
+                if(_budget.channel_limit && hc.out_buffer.size() + count > _budget.channel_limit)
+                    excess = hc.out_buffer.size() + count - _budget.channel_limit;
+                if(_budget.global_limit && _budget_stats.pending + count > _budget.global_limit)
+                    excess = std::max(excess, _budget_stats.pending + count - _budget.global_limit);
+                return excess;
+            }
+
+            // update the accounting after bytes were added to or removed from hc.out_buffer
+            void _account(half_channel& hc, std::size_t added, std::size_t removed)
+            {
+                _budget_stats.pending += added;
+                _budget_stats.pending -= removed;
+                _budget_stats.peak = std::max(_budget_stats.peak, _budget_stats.pending);
+                bool full = _budget.channel_limit && hc.out_buffer.size() >= _budget.channel_limit;
+                if(full != hc.full)
+                {
+                    hc.full = full;
+                    if(full)
+                        ++_full_channels;
+                    else
+                        --_full_channels;
+                }
+            }
+
+            // create a half channel for fl (nullptr if fl is empty), switches fl to non-blocking mode
+            half_channel* _add_half_channel(smux_channel ch, std::unique_ptr<file> fl)
+            {
+                if(!fl)
+                    return nullptr;
+                fl->set_nonblocking();
+                _half_channels.emplace_back(ch, fl.get());
+                _files.push_back(std::move(fl));
+                return &_half_channels.back();
             }
 
             // init _pipesig_r/w
             void _setup_shutdown_pipe();
+            // let the elastic buffer of _smux draw its segments from the block_pool
+            void _setup_tx_segments();
+            // segment functions for the elastic buffer
+            static void* _alloc_tx_segment(void*, std::size_t size);
+            static void _release_tx_segment(void*, void* segment);
     };
 } // namespace smux_client
 
@@ -0,0 +1,51 @@
+// cnf_test.cpp
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cnf_argv.h"
+
+using namespace smux_client;
+
+namespace
+{
+    // parse the options args (without program name)
+    void parse(cnf_argv& cnf, std::vector<std::string> args)
+    {
+        args.insert(args.begin(), "smux");
+        std::vector<char*> argv;
+        for(auto& arg : args)
+            argv.push_back(&arg[0]);
+        argv.push_back(nullptr);
+        optind = 0; // restart getopt()
+        cnf.parse(static_cast<int>(args.size()), argv.data());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(configuration);
+
+BOOST_AUTO_TEST_CASE(sizes)
+{
+    cnf_argv cnf;
+    parse(cnf, {"-q", "4k", "-Q", "2M", "-r", "100"});
+    BOOST_TEST(cnf.budget().channel_limit == 4096u);
+    BOOST_TEST(cnf.budget().global_limit == 2u * 1024 * 1024);
+    BOOST_TEST(cnf.read_size() == 100u);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_sizes)
+{
+    for(std::string opt : {"-q", "-Q", "-r", "-s"})
+    {
+        for(std::string value : {"-1", "+1", " 1", "1x", "k", "", "0x10", "99999999999999G"})
+        {
+            cnf_argv cnf;
+            BOOST_CHECK_THROW(parse(cnf, {opt, value}), config_error);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
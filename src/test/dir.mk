@@ -0,0 +1,8 @@
+## Makefile template for subdirs
+# vim:set ft=make:
+
+MYDIR                   := $(dir $(lastword $(MAKEFILE_LIST)))
+
+SRC_CXX_test            := test.cpp rt_test.cpp cnf_test.cpp
+
+include $(BUILDIR)/mk/dir.mk
@@ -0,0 +1,303 @@
+// rt_test.cpp
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <smux.hpp>
+
+#include "file_factory.h"
+#include "rt.h"
+
+using namespace smux_client;
+
+namespace
+{
+    // temporary directory, removed with its files
+    struct temp_dir
+    {
+        std::string path;
+
+        temp_dir()
+        {
+            char tmpl[] = "/tmp/smux_rt_test_XXXXXX";
+            BOOST_REQUIRE(mkdtemp(tmpl) != nullptr);
+            path = tmpl;
+        }
+        ~temp_dir()
+        {
+            std::string cmd = "rm -rf '" + path + "'";
+            if(system(cmd.c_str()) != 0)
+                BOOST_TEST_MESSAGE("removing " << path << " failed");
+        }
+    };
+
+    std::unique_ptr<file> open_file(std::string const& path, file_mode mode)
+    {
+        return file_factory::get()->create(file_def{"file", mode, path});
+    }
+
+    std::string read_file(std::string const& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    // payload of channel ch in smux data
+    std::string decode(std::string const& data, smux_channel ch)
+    {
+        std::size_t pos = 0;
+        smux::connection conn(4096, 4096);
+        conn.set_read_fn([&data, &pos](void* buf, std::size_t count) {
+            count = std::min(count, data.size() - pos);
+            std::memcpy(buf, data.data() + pos, count);
+            pos += count;
+            return static_cast<ssize_t>(count);
+        });
+        conn.subscribe(ch);
+
+        std::string out;
+        char buf[4096];
+        do
+        {
+            conn.read();
+            smux_channel from;
+            while(std::size_t n = conn.recv(&from, buf, sizeof(buf)))
+            {
+                if(from == ch)
+                    out.append(buf, n);
+            }
+        } while(pos < data.size());
+        return out;
+    }
+
+    // run rt until done() returns true (at most 5 seconds)
+    void run_until(runtime_system& rt, std::function<bool()> const& done)
+    {
+        std::exception_ptr error;
+        std::thread loop([&rt, &error] {
+            try
+            {
+                rt.run();
+            } catch(...)
+            {
+                error = std::current_exception();
+            }
+        });
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while(!done() && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        rt.shutdown();
+        loop.join();
+        if(error)
+            std::rethrow_exception(error);
+    }
+
+    // run rt until the master output carries expected on channel ch
+    std::string run_until_sent(runtime_system& rt, std::string const& master_path,
+            smux_channel ch, std::string const& expected)
+    {
+        std::string out;
+        run_until(rt, [&] {
+            out = decode(read_file(master_path), ch);
+            return out.size() >= expected.size();
+        });
+        return out;
+    }
+
+    // writes data into a new fifo and keeps it open until destruction
+    struct fifo_feeder
+    {
+        std::atomic<bool> finished{false};
+        std::thread thread;
+
+        fifo_feeder(std::string const& path, std::string const& data)
+        {
+            BOOST_REQUIRE(mkfifo(path.c_str(), 0600) == 0);
+            thread = std::thread([this, path, data] {
+                int fd = open(path.c_str(), O_WRONLY);
+                if(fd < 0)
+                    return;
+                if(write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size()))
+                    BOOST_TEST_MESSAGE("writing to " << path << " failed");
+                while(!finished)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                close(fd);
+            });
+        }
+        ~fifo_feeder()
+        {
+            finished = true;
+            thread.join();
+        }
+    };
+
+    std::string pattern(std::size_t size)
+    {
+        std::string data(size, '\0');
+        for(std::size_t i = 0; i < size; ++i)
+            data[i] = static_cast<char>(i * 7 + i / 251);
+        return data;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(runtime);
+
+// reads larger than a frame have to be split into several frames
+BOOST_AUTO_TEST_CASE(large_reads)
+{
+    temp_dir dir;
+    std::string data = pattern(300 * 1024);
+    std::ofstream(dir.path + "/in", std::ios::binary) << data;
+
+    runtime_system rt(nullptr, open_file(dir.path + "/master", file_mode::out));
+    rt.add_channel(1, open_file(dir.path + "/in", file_mode::in), nullptr);
+    rt.set_buffer_sizes(100000, runtime_system::SMUX_BUFFER_SIZE);
+
+    BOOST_TEST((run_until_sent(rt, dir.path + "/master", 1, data) == data));
+}
+
+// adaptive read sizes grow up to ADAPTIVE_MAX_SIZE, beyond the maximum frame size
+BOOST_AUTO_TEST_CASE(adaptive_reads)
+{
+    temp_dir dir;
+    std::string data = pattern(3 * 1024 * 1024);
+    std::ofstream(dir.path + "/in", std::ios::binary) << data;
+
+    runtime_system rt(nullptr, open_file(dir.path + "/master", file_mode::out));
+    rt.add_channel(1, open_file(dir.path + "/in", file_mode::in), nullptr);
+    rt.set_buffer_sizes(runtime_system::ADAPTIVE_MAX_SIZE / 2, runtime_system::SMUX_BUFFER_SIZE);
+    rt.set_adaptive(true);
+
+    BOOST_TEST((run_until_sent(rt, dir.path + "/master", 1, data) == data));
+}
+
+// a fragment larger than the budget must still reach the channel with the spill policy
+BOOST_AUTO_TEST_CASE(spill_oversized)
+{
+    temp_dir dir;
+    std::string data = pattern(3000);
+    std::string frames;
+    smux::connection enc(8192, 64);
+    enc.set_write_fn([&frames](const void* buf, std::size_t count) {
+        frames.append(static_cast<const char*>(buf), count);
+        return static_cast<ssize_t>(count);
+    });
+    BOOST_TEST(enc.send(1, data.data(), data.size()) == data.size());
+    BOOST_TEST(enc.write() == 0);
+
+    // feed the master through a fifo that stays open (eof of the master ends the loop)
+    std::string master_path = dir.path + "/master";
+    fifo_feeder feeder(master_path, frames);
+
+    runtime_system rt(open_file(master_path, file_mode::in), nullptr);
+    rt.add_channel(1, nullptr, open_file(dir.path + "/out", file_mode::out));
+    rt.set_buffer_sizes(4096, runtime_system::SMUX_BUFFER_SIZE);
+    budget_config budget;
+    budget.channel_limit = 1024;
+    budget.policy = budget_policy::spill;
+    rt.set_budget(budget);
+
+    std::string out;
+    run_until(rt, [&] {
+        out = read_file(dir.path + "/out");
+        return out.size() >= data.size();
+    });
+    BOOST_TEST((out == data));
+}
+
+// files read and written through io_uring (epoll if unavailable), in both directions, with
+// split threads and adaptive buffers (not resized while being read into)
+BOOST_AUTO_TEST_CASE(uring_io)
+{
+    for(unsigned mode = 0; mode < 4; ++mode)
+    {
+        bool split = mode & 1, adaptive = mode & 2;
+        temp_dir dir;
+        std::string data = pattern(1024 * 1024);
+        std::ofstream(dir.path + "/in", std::ios::binary) << data;
+
+        // channel -> master
+        {
+            runtime_system rt(nullptr, open_file(dir.path + "/master", file_mode::out));
+            rt.add_channel(1, open_file(dir.path + "/in", file_mode::in), nullptr);
+            rt.set_poller_type(poller_type::uring);
+            rt.set_split(split);
+            rt.set_adaptive(adaptive);
+            BOOST_TEST((run_until_sent(rt, dir.path + "/master", 1, data) == data));
+        }
+
+        // master -> channel
+        fifo_feeder feeder(dir.path + "/fifo", read_file(dir.path + "/master"));
+        runtime_system rt(open_file(dir.path + "/fifo", file_mode::in), nullptr);
+        rt.add_channel(1, nullptr, open_file(dir.path + "/out", file_mode::out));
+        rt.set_poller_type(poller_type::uring);
+        rt.set_split(split);
+        rt.set_adaptive(adaptive);
+        std::string out;
+        run_until(rt, [&] {
+            out = read_file(dir.path + "/out");
+            return out.size() >= data.size();
+        });
+        BOOST_TEST((out == data));
+    }
+}
+
+// split mode with traffic in both directions at the same time: the RX and TX threads share
+// the smux connection, each using its own half (also when resizing its buffer)
+BOOST_AUTO_TEST_CASE(split_duplex)
+{
+    for(poller_type type : {poller_type::epoll, poller_type::uring})
+    {
+        temp_dir dir;
+        std::string up = pattern(1024 * 1024), down = pattern(1024 * 1024 + 17);
+        std::ofstream(dir.path + "/in", std::ios::binary) << up;
+
+        std::string frames;
+        smux::connection enc(8192, 64);
+        enc.set_write_fn([&frames](const void* buf, std::size_t count) {
+            frames.append(static_cast<const char*>(buf), count);
+            return static_cast<ssize_t>(count);
+        });
+        for(std::size_t done = 0; done < down.size();)
+        {
+            done += enc.send(2, down.data() + done, down.size() - done);
+            BOOST_TEST(enc.write() == 0);
+        }
+        fifo_feeder feeder(dir.path + "/fifo", frames);
+
+        runtime_system rt(open_file(dir.path + "/fifo", file_mode::in),
+                open_file(dir.path + "/master", file_mode::out));
+        rt.add_channel(1, open_file(dir.path + "/in", file_mode::in), nullptr);
+        rt.add_channel(2, nullptr, open_file(dir.path + "/out", file_mode::out));
+        rt.set_poller_type(type);
+        rt.set_split(true);
+        rt.set_adaptive(true);
+
+        std::string sent, received;
+        run_until(rt, [&] {
+            sent = decode(read_file(dir.path + "/master"), 1);
+            received = read_file(dir.path + "/out");
+            return sent.size() >= up.size() && received.size() >= down.size();
+        });
+        BOOST_TEST((sent == up));
+        BOOST_TEST((received == down));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
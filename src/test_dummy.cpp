@@ -1,7 +0,0 @@
-#include <iostream>
-
-int main(void)
-{
-    std::clog << "No tests implemented yet..." << std::endl;
-    return 0;
-}